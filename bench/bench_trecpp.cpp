@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+
+#include <trecpp/html.hpp>
+#include <trecpp/trecpp.hpp>
+#include <trecpp/writer.hpp>
+
+#include "generator.hpp"
+
+using trecpp::bench::Generator;
+using trecpp::bench::SizeDistribution;
+
+namespace {
+std::atomic<std::size_t> allocations{0};
+}
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size == 0 ? 1 : size); ptr != nullptr) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+
+struct Measurement {
+    double seconds;
+    std::size_t records;
+    std::size_t allocations;
+};
+
+/// Runs `fn`, which returns the number of parsed records, `repeat` times,
+/// and returns the fastest run.
+[[nodiscard]] auto measure(std::function<std::size_t()> const &fn, std::size_t repeat)
+    -> Measurement
+{
+    std::optional<Measurement> best;
+    for (std::size_t run = 0; run < repeat; ++run) {
+        auto allocations_before = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        auto records = fn();
+        auto seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto allocated = allocations.load() - allocations_before;
+        if (not best or seconds < best->seconds) {
+            best = Measurement{seconds, records, allocated};
+        }
+    }
+    return *best;
+}
+
+void report(std::string const &name, std::size_t bytes, Measurement const &measurement)
+{
+    auto records = static_cast<double>(std::max<std::size_t>(measurement.records, 1));
+    std::cout << std::left << std::setw(34) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(12)
+              << static_cast<double>(bytes) / (1 << 20) / measurement.seconds << std::setw(14)
+              << static_cast<double>(measurement.records) / measurement.seconds
+              << std::setprecision(2) << std::setw(14)
+              << static_cast<double>(measurement.allocations) / records << '\n';
+}
+
+template <typename Parser>
+[[nodiscard]] auto count_records(Parser &parser) -> std::size_t
+{
+    std::size_t records = 0;
+    while (not parser.eof()) {
+        records += static_cast<std::size_t>(trecpp::holds_record(parser.read_record()));
+    }
+    return records;
+}
+
+/// Stream buffer discarding everything written to it.
+class NullStreambuf : public std::streambuf {
+   protected:
+    auto overflow(int_type ch) -> int_type override { return traits_type::not_eof(ch); }
+    auto xsputn(char const *, std::streamsize count) -> std::streamsize override
+    {
+        return count;
+    }
+};
+
+template <typename ParseAll>
+[[nodiscard]] auto count_all_records(ParseAll &&parse_all) -> std::size_t
+{
+    std::size_t records = 0;
+    parse_all([&](trecpp::RecordView const &) { ++records; }, [](trecpp::ParseError const &) {});
+    return records;
+}
+
+template <typename Parser>
+[[nodiscard]] auto count_batched_records(Parser &parser) -> std::size_t
+{
+    std::size_t records = 0;
+    trecpp::RecordBatch batch;
+    while (parser.read_batch(batch, 1000) > 0) {
+        records += batch.size();
+    }
+    return records;
+}
+
+/// The buffering scheme `web::TrecParser` used before switching to a sliding window:
+/// every record erases itself from the front of the buffer.
+class EraseParser {
+   public:
+    EraseParser(std::istream &input, std::size_t batch_size)
+        : input_(input), batch_size_(batch_size)
+    {
+    }
+    [[nodiscard]] auto eof() const -> bool { return eof_; }
+    [[nodiscard]] auto read_record() -> trecpp::Result
+    {
+        auto view = read_enough();
+        if (not view) {
+            eof_ = true;
+            return trecpp::Error{"EOF"};
+        }
+        auto res = trecpp::web::parse(*view);
+        buf_.erase(buf_.begin(), buf_.begin() + view->size());
+        return res;
+    }
+
+   private:
+    [[nodiscard]] auto read_enough() -> std::optional<std::string_view>
+    {
+        auto const &doc_end = trecpp::detail::DOC_END;
+        std::string_view view(buf_.data(), buf_.size());
+        auto pos = view.find(doc_end);
+        while (pos == std::string_view::npos) {
+            auto old_size = buf_.size();
+            buf_.resize(buf_.size() + batch_size_);
+            input_.read(&buf_[old_size], batch_size_);
+            if (input_.gcount() == 0) {
+                return std::nullopt;
+            }
+            buf_.resize(old_size + input_.gcount());
+            view = std::string_view(buf_.data(), buf_.size());
+            pos = view.find(doc_end, std::max(old_size, doc_end.size()) - doc_end.size());
+        }
+        return std::string_view(buf_.data(), pos + doc_end.size());
+    }
+
+    std::istream &input_;
+    std::size_t batch_size_;
+    std::vector<char> buf_{};
+    bool eof_ = false;
+};
+
+template <typename Range>
+[[nodiscard]] auto count_range(Range &&range) -> std::size_t
+{
+    std::size_t records = 0;
+    for (auto const &record : range) {
+        (void)record;
+        ++records;
+    }
+    return records;
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t web_records = 10000;
+    std::size_t text_records = 10000;
+    std::uint64_t seed = 1;
+    std::string distribution = "lognormal";
+    SizeDistribution sizes;
+    std::size_t repeat = 3;
+    std::vector<std::size_t> batch_sizes{10000, 1 << 20};
+    std::optional<std::string> web_output = std::nullopt;
+    std::optional<std::string> text_output = std::nullopt;
+    CLI::App app{"Measure trecpp throughput on synthetic collections."};
+    app.add_option("--web-records", web_records, "Number of trecweb records", true);
+    app.add_option("--text-records", text_records, "Number of trectext records", true);
+    app.add_option("--seed", seed, "Random seed", true);
+    app.add_option("--size-distribution", distribution, "Content size distribution", true)
+        ->check(CLI::IsMember({"fixed", "uniform", "lognormal"}));
+    app.add_option("--mean-size", sizes.mean, "Mean content size (fixed, lognormal)", true);
+    app.add_option("--sigma", sizes.sigma, "Sigma of the log of content size (lognormal)", true);
+    app.add_option("--min-size", sizes.min, "Minimum content size", true);
+    app.add_option("--max-size", sizes.max, "Maximum content size", true);
+    app.add_option("--repeat", repeat, "Number of runs; the fastest is reported", true);
+    app.add_option("--batch-sizes",
+                   batch_sizes,
+                   "Read sizes for comparing erase and sliding window buffering");
+    app.add_option("--web-output", web_output, "Also write the trecweb collection to a file");
+    app.add_option("--text-output", text_output, "Also write the trectext collection to a file");
+    CLI11_PARSE(app, argc, argv);
+    if (distribution == "fixed") {
+        sizes.kind = SizeDistribution::Kind::Fixed;
+    } else if (distribution == "uniform") {
+        sizes.kind = SizeDistribution::Kind::Uniform;
+    }
+
+    std::string web;
+    Generator(seed, sizes).web(web_records, web);
+    std::string text;
+    Generator(seed, sizes).text(text_records, text);
+    if (web_output) {
+        std::ofstream(*web_output) << web;
+    }
+    if (text_output) {
+        std::ofstream(*text_output) << text;
+    }
+
+    std::cout << "trecweb: " << web_records << " records, " << web.size() << " bytes\n"
+              << "trectext: " << text_records << " records, " << text.size() << " bytes\n\n"
+              << std::left << std::setw(34) << "benchmark" << std::right << std::setw(12)
+              << "MB/s" << std::setw(14) << "records/s" << std::setw(14) << "allocs/record"
+              << '\n';
+
+    report("web::parse", web.size(), measure([&] {
+               std::size_t records = 0;
+               std::size_t pos = 0;
+               while (auto view = trecpp::detail::next_record(web, pos)) {
+                   records += static_cast<std::size_t>(
+                       trecpp::holds_record(trecpp::web::parse(*view)));
+               }
+               return records;
+           },
+           repeat));
+    report("web::TrecParser", web.size(), measure([&] {
+               std::istringstream is(web);
+               trecpp::web::TrecParser parser(is);
+               return count_records(parser);
+           },
+           repeat));
+    for (auto batch_size : batch_sizes) {
+        auto suffix = " batch=" + std::to_string(batch_size);
+        report("web erase buffer" + suffix, web.size(), measure([&] {
+                   std::istringstream is(web);
+                   EraseParser parser(is, batch_size);
+                   return count_records(parser);
+               },
+               repeat));
+        report("web::TrecParser" + suffix, web.size(), measure([&] {
+                   std::istringstream is(web);
+                   trecpp::web::TrecParser parser(is, batch_size);
+                   return count_records(parser);
+               },
+               repeat));
+    }
+    report("web::TrecParser ViewSource", web.size(), measure([&] {
+               trecpp::web::BasicTrecParser<trecpp::ViewSource> parser(trecpp::ViewSource{web});
+               return count_records(parser);
+           },
+           repeat));
+    report("web::records", web.size(), measure([&] {
+               std::istringstream is(web);
+               return count_range(trecpp::web::records(is));
+           },
+           repeat));
+    report("web::TrecParser::stream_record", web.size(), measure([&] {
+               std::istringstream is(web);
+               trecpp::web::TrecParser parser(is);
+               std::size_t records = 0;
+               std::size_t content = 0;
+               while (not parser.eof()) {
+                   auto error = parser.stream_record(
+                       [](trecpp::RecordView const &) {},
+                       [&](std::string_view chunk) { content += chunk.size(); });
+                   records += static_cast<std::size_t>(not error);
+               }
+               return records;
+           },
+           repeat));
+    report("web::TrecParser::read_batch", web.size(), measure([&] {
+               std::istringstream is(web);
+               trecpp::web::TrecParser parser(is);
+               return count_batched_records(parser);
+           },
+           repeat));
+    report("web::parse_all", web.size(), measure([&] {
+               std::istringstream is(web);
+               return count_all_records([&](auto &&on_record, auto &&on_error) {
+                   trecpp::web::parse_all(is, on_record, on_error);
+               });
+           },
+           repeat));
+    for (auto framing : {trecpp::web::Framing::Scan, trecpp::web::Framing::ContentLength}) {
+        auto name = framing == trecpp::web::Framing::Scan ? "web::parse_all docno"
+                                                          : "web::parse_all docno content-length";
+        report(name, web.size(), measure([&] {
+                   return count_all_records([&](auto &&on_record, auto &&on_error) {
+                       trecpp::web::parse_all(
+                           web, on_record, on_error, trecpp::Fields::Docno, framing);
+                   });
+               },
+               repeat));
+    }
+    for (auto format : {"tsv", "jsonl", "binary"}) {
+        report(std::string("web::parse_all + write ") + format, web.size(), measure([&] {
+                   NullStreambuf discard;
+                   std::ostream os(&discard);
+                   trecpp::RecordWriter writer(os, trecpp::parse_format(format));
+                   return count_all_records([&](auto &&on_record, auto &&on_error) {
+                       trecpp::web::parse_all(
+                           web,
+                           [&](trecpp::RecordView const &record) {
+                               writer.write(record);
+                               on_record(record);
+                           },
+                           on_error);
+                   });
+               },
+               repeat));
+    }
+    report("web::parse_all + html::tokenize", web.size(), measure([&] {
+               std::size_t tokens = 0;
+               trecpp::html::Tokenizer tokenizer;
+               auto records = count_all_records([&](auto &&on_record, auto &&on_error) {
+                   trecpp::web::parse_all(
+                       web,
+                       [&](trecpp::RecordView const &record) {
+                           tokenizer.tokenize(record.content(),
+                                              [&](std::string_view) { ++tokens; });
+                           on_record(record);
+                       },
+                       on_error);
+               });
+               return tokens > 0 ? records : 0;
+           },
+           repeat));
+    report("text::read_record", text.size(), measure([&] {
+               std::istringstream is(text);
+               std::size_t records = 0;
+               while (not is.eof()) {
+                   records += static_cast<std::size_t>(
+                       trecpp::holds_record(trecpp::text::read_record(is)));
+                   is >> std::ws;
+               }
+               return records;
+           },
+           repeat));
+    report("text::read_subsequent_record", text.size(), measure([&] {
+               std::istringstream is(text);
+               std::size_t records = 0;
+               while (not is.eof()) {
+                   records += static_cast<std::size_t>(
+                       trecpp::holds_record(trecpp::text::read_subsequent_record(is)));
+               }
+               return records;
+           },
+           repeat));
+    report("text::TrecParser", text.size(), measure([&] {
+               std::istringstream is(text);
+               trecpp::text::TrecParser parser(is);
+               return count_records(parser);
+           },
+           repeat));
+    report("text::records", text.size(), measure([&] {
+               std::istringstream is(text);
+               return count_range(trecpp::text::records(is));
+           },
+           repeat));
+    report("text::TrecParser::read_batch", text.size(), measure([&] {
+               std::istringstream is(text);
+               trecpp::text::TrecParser parser(is);
+               return count_batched_records(parser);
+           },
+           repeat));
+    report("text::parse_all", text.size(), measure([&] {
+               std::istringstream is(text);
+               return count_all_records([&](auto &&on_record, auto &&on_error) {
+                   trecpp::text::parse_all(is, on_record, on_error);
+               });
+           },
+           repeat));
+    return 0;
+}
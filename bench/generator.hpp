@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace trecpp::bench {
+
+/// Deterministic source of random numbers.
+///
+/// `std::mt19937_64` produces the same sequence everywhere, but standard distributions
+/// do not, so all sampling is implemented here to keep corpora identical across platforms.
+class Random {
+   public:
+    explicit Random(std::uint64_t seed) : engine_(seed) {}
+
+    /// Uniform in [0, 1).
+    [[nodiscard]] auto uniform() -> double
+    {
+        return static_cast<double>(engine_() >> 11U) * (1.0 / 9007199254740992.0);
+    }
+    /// Uniform in [0, n).
+    [[nodiscard]] auto below(std::size_t n) -> std::size_t
+    {
+        return static_cast<std::size_t>(uniform() * static_cast<double>(n));
+    }
+    /// Standard normal, using the Box-Muller transform.
+    [[nodiscard]] auto normal() -> double
+    {
+        auto u = 1.0 - uniform();
+        auto v = uniform();
+        constexpr double pi = 3.14159265358979323846;
+        return std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * pi * v);
+    }
+
+   private:
+    std::mt19937_64 engine_;
+};
+
+/// Distribution of generated document (content) sizes in bytes.
+struct SizeDistribution {
+    enum class Kind { Fixed, Uniform, Lognormal };
+    Kind kind = Kind::Lognormal;
+    /// Mean size for `Fixed` and `Lognormal`.
+    double mean = 10000;
+    /// Standard deviation of the logarithm for `Lognormal`.
+    double sigma = 1.0;
+    /// Bounds for `Uniform`; all samples are clamped to them.
+    std::size_t min = 16;
+    std::size_t max = std::size_t{1} << 24;
+
+    [[nodiscard]] auto sample(Random &random) const -> std::size_t
+    {
+        double size = mean;
+        switch (kind) {
+        case Kind::Fixed:
+            break;
+        case Kind::Uniform:
+            size = min + random.uniform() * static_cast<double>(max - min);
+            break;
+        case Kind::Lognormal:
+            // Parametrized so that the expected value is `mean`.
+            size = std::exp(std::log(mean) - sigma * sigma / 2 + sigma * random.normal());
+            break;
+        }
+        return std::clamp(static_cast<std::size_t>(size), min, max);
+    }
+};
+
+/// Generates synthetic trecweb (GOV2-like) and trectext collections.
+class Generator {
+   public:
+    Generator(std::uint64_t seed, SizeDistribution sizes) : random_(seed), sizes_(sizes) {}
+
+    /// Appends `count` trecweb records to `out`.
+    void web(std::size_t count, std::string &out)
+    {
+        std::string body;
+        for (std::size_t idx = 0; idx < count; ++idx) {
+            body.clear();
+            html(sizes_.sample(random_), body);
+            auto url = "http://www." + word() + ".gov/" + word() + '/' + std::to_string(idx)
+                       + ".html";
+            out += "<DOC>\n<DOCNO>GX";
+            out += docno(idx);
+            out += "</DOCNO>\n<DOCHDR>\n";
+            out += url;
+            out += "\nHTTP/1.1 200 OK\n"
+                   "Date: Tue, 09 Dec 2003 21:21:33 GMT\n"
+                   "Server: Apache/1.3.27 (Unix)\n"
+                   "Last-Modified: Tue, 26 Mar 2002 19:24:25 GMT\n"
+                   "Accept-Ranges: bytes\n"
+                   "Content-Length: ";
+            out += std::to_string(body.size());
+            out += "\nConnection: close\n"
+                   "Content-Type: text/html\n"
+                   "</DOCHDR>\n";
+            out += body;
+            out += "</DOC>\n";
+        }
+    }
+
+    /// Appends `count` trectext records to `out`.
+    void text(std::size_t count, std::string &out)
+    {
+        static constexpr std::array<std::string_view, 6> extra_tags = {
+            "HEADLINE", "DATE", "BYLINE", "HL", "DATELINE", "LP"};
+        for (std::size_t idx = 0; idx < count; ++idx) {
+            out += "<DOC>\n<DOCNO> FT";
+            out += docno(idx);
+            out += " </DOCNO>\n<DOCID>";
+            out += std::to_string(idx);
+            out += "</DOCID>\n";
+            auto size = sizes_.sample(random_);
+            auto sections = 1 + random_.below(extra_tags.size());
+            for (std::size_t section = 0; section < sections; ++section) {
+                auto tag = section + 1 == sections ? std::string_view("TEXT")
+                                                   : extra_tags[random_.below(extra_tags.size())];
+                out += '<';
+                out += tag;
+                out += ">\n";
+                words(section + 1 == sections ? size : size / 16 + 1, out);
+                out += "\n</";
+                out += tag;
+                out += ">\n";
+            }
+            out += "</DOC>\n";
+        }
+    }
+
+   private:
+    [[nodiscard]] static auto docno(std::size_t idx) -> std::string
+    {
+        auto number = std::to_string(idx);
+        return std::string(number.size() < 10 ? 10 - number.size() : 0, '0') + number;
+    }
+
+    [[nodiscard]] auto word() -> std::string
+    {
+        static constexpr std::string_view letters = "etaoinshrdlcumwfgypbvkjxqz";
+        std::string word;
+        // Skewed towards short words and frequent letters.
+        auto length = 1 + random_.below(4) + random_.below(6);
+        for (std::size_t idx = 0; idx < length; ++idx) {
+            auto letter = random_.below(letters.size());
+            word.push_back(letters[letter * random_.below(letters.size()) / letters.size()]);
+        }
+        return word;
+    }
+
+    /// Appends words until `size` bytes have been appended.
+    void words(std::size_t size, std::string &out)
+    {
+        auto end = out.size() + size;
+        while (out.size() < end) {
+            out += word();
+            out += random_.below(12) == 0 ? '\n' : ' ';
+        }
+    }
+
+    /// Appends a simple HTML page of roughly `size` bytes.
+    void html(std::size_t size, std::string &out)
+    {
+        auto end = out.size() + size;
+        out += "<html>\n<head><title>";
+        words(32, out);
+        out += "</title>\n<style>p { margin: 0; }</style></head>\n<body>\n";
+        while (out.size() < end) {
+            switch (random_.below(4)) {
+            case 0:
+                out += "<a href=\"http://www." + word() + ".gov/\">";
+                words(16, out);
+                out += "</a>\n";
+                break;
+            case 1:
+                out += "<h2>";
+                words(24, out);
+                out += "</h2>\n";
+                break;
+            default:
+                out += "<p>";
+                words(200, out);
+                out += "</p>\n";
+            }
+        }
+        out += "</body>\n</html>\n";
+    }
+
+    Random random_;
+    SizeDistribution sizes_;
+};
+
+} // namespace trecpp::bench
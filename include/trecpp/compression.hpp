@@ -0,0 +1,333 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+#ifdef TRECPP_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "trecpp.hpp"
+
+namespace trecpp {
+
+enum class Compression { None, Gzip, Zstd, Auto };
+
+namespace detail {
+
+    [[nodiscard]] auto ends_with(std::string_view str, std::string_view suffix) -> bool
+    {
+        return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+    }
+
+    /// Recognizes compression format by the first bytes of a stream.
+    [[nodiscard]] auto detect_compression(std::string_view magic) -> Compression
+    {
+        if (magic.size() >= 2 && magic[0] == '\x1f' && magic[1] == '\x8b') {
+            return Compression::Gzip;
+        }
+        if (magic.size() >= 4 && magic.substr(0, 4) == std::string_view("\x28\xb5\x2f\xfd", 4)) {
+            return Compression::Zstd;
+        }
+        return Compression::None;
+    }
+
+    /// Decompresses data read from a stream buffer in blocks.
+    ///
+    /// In `Compression::Auto` mode, the format is detected from the first bytes of the input,
+    /// and uncompressed data is passed through as is.
+    class Decoder {
+       public:
+        Decoder(std::streambuf *source, Compression compression, std::size_t block_size)
+            : source_(source), compression_(compression), input_(block_size)
+        {
+        }
+        Decoder(Decoder const &) = delete;
+        Decoder &operator=(Decoder const &) = delete;
+        Decoder(Decoder &&) = delete;
+        Decoder &operator=(Decoder &&) = delete;
+        ~Decoder()
+        {
+            if (gzip_initialized_) {
+                inflateEnd(&gzip_);
+            }
+#ifdef TRECPP_WITH_ZSTD
+            if (zstd_ != nullptr) {
+                ZSTD_freeDCtx(zstd_);
+            }
+#endif
+        }
+
+        /// Decompresses at most `size` bytes into `out`.
+        /// Returns 0 only once all input has been decompressed.
+        [[nodiscard]] auto read(char *out, std::size_t size) -> std::size_t
+        {
+            if (size == 0) {
+                return 0;
+            }
+            if (compression_ == Compression::Auto) {
+                (void)refill();
+                compression_ = detect_compression(
+                    std::string_view(input_.data() + in_pos_, in_end_ - in_pos_));
+            }
+            switch (compression_) {
+            case Compression::Gzip:
+                return read_gzip(out, size);
+            case Compression::Zstd:
+                return read_zstd(out, size);
+            default:
+                return read_plain(out, size);
+            }
+        }
+
+       private:
+        /// Reads the next block of the input if the current one has been used up.
+        /// Returns `false` at the end of the input.
+        [[nodiscard]] auto refill() -> bool
+        {
+            if (in_pos_ < in_end_) {
+                return true;
+            }
+            in_pos_ = 0;
+            in_end_ = static_cast<std::size_t>(
+                source_->sgetn(input_.data(), static_cast<std::streamsize>(input_.size())));
+            return in_end_ > 0;
+        }
+
+        [[nodiscard]] auto read_plain(char *out, std::size_t size) -> std::size_t
+        {
+            if (in_pos_ < in_end_) {
+                auto count = std::min(size, in_end_ - in_pos_);
+                std::memcpy(out, input_.data() + in_pos_, count);
+                in_pos_ += count;
+                return count;
+            }
+            return static_cast<std::size_t>(
+                source_->sgetn(out, static_cast<std::streamsize>(size)));
+        }
+
+        [[nodiscard]] auto read_gzip(char *out, std::size_t size) -> std::size_t
+        {
+            if (not gzip_initialized_) {
+                gzip_ = z_stream{};
+                // Accept both zlib and gzip headers.
+                if (inflateInit2(&gzip_, MAX_WBITS + 32) != Z_OK) {
+                    throw std::runtime_error("Unable to initialize gzip decompression");
+                }
+                gzip_initialized_ = true;
+            }
+            auto capacity = static_cast<uInt>(std::min<std::size_t>(size, UINT32_MAX));
+            gzip_.next_out = reinterpret_cast<Bytef *>(out);
+            gzip_.avail_out = capacity;
+            while (gzip_.avail_out == capacity) {
+                auto has_input = refill();
+                if (not has_input && member_finished_) {
+                    return 0;
+                }
+                if (has_input && member_finished_) {
+                    // Concatenated gzip members, as produced by e.g. `cat a.gz b.gz`.
+                    inflateReset(&gzip_);
+                    member_finished_ = false;
+                }
+                gzip_.next_in = reinterpret_cast<Bytef *>(input_.data() + in_pos_);
+                gzip_.avail_in = static_cast<uInt>(in_end_ - in_pos_);
+                auto ret = inflate(&gzip_, Z_NO_FLUSH);
+                in_pos_ = in_end_ - gzip_.avail_in;
+                if (ret == Z_STREAM_END) {
+                    member_finished_ = true;
+                } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                    throw std::runtime_error(std::string("Gzip decompression failed: ")
+                                             + (gzip_.msg != nullptr ? gzip_.msg : "unknown"));
+                } else if (not has_input && gzip_.avail_out == capacity) {
+                    throw std::runtime_error("Unexpected end of gzip stream");
+                }
+            }
+            return capacity - gzip_.avail_out;
+        }
+
+        [[nodiscard]] auto read_zstd(char *out, std::size_t size) -> std::size_t
+        {
+#ifdef TRECPP_WITH_ZSTD
+            if (zstd_ == nullptr) {
+                zstd_ = ZSTD_createDCtx();
+                if (zstd_ == nullptr) {
+                    throw std::runtime_error("Unable to initialize zstd decompression");
+                }
+            }
+            ZSTD_outBuffer output{out, size, 0};
+            while (output.pos == 0) {
+                auto has_input = refill();
+                if (not has_input && member_finished_) {
+                    return 0;
+                }
+                ZSTD_inBuffer input{input_.data() + in_pos_, in_end_ - in_pos_, 0};
+                auto ret = ZSTD_decompressStream(zstd_, &output, &input);
+                in_pos_ += input.pos;
+                if (ZSTD_isError(ret)) {
+                    throw std::runtime_error(std::string("Zstd decompression failed: ")
+                                             + ZSTD_getErrorName(ret));
+                }
+                member_finished_ = ret == 0;
+                if (not has_input && output.pos == 0 && not member_finished_) {
+                    throw std::runtime_error("Unexpected end of zstd stream");
+                }
+            }
+            return output.pos;
+#else
+            (void)out;
+            (void)size;
+            throw std::runtime_error("trecpp was built without zstd support");
+#endif
+        }
+
+        std::streambuf *source_;
+        Compression compression_;
+        std::vector<char> input_;
+        std::size_t in_pos_ = 0;
+        std::size_t in_end_ = 0;
+        bool member_finished_ = false;
+        z_stream gzip_{};
+        bool gzip_initialized_ = false;
+#ifdef TRECPP_WITH_ZSTD
+        ZSTD_DCtx *zstd_ = nullptr;
+#endif
+    };
+
+} // namespace detail
+
+/// Detects compression of a file by its extension, falling back to its first bytes.
+[[nodiscard]] auto detect_compression(std::string const &path) -> Compression
+{
+    if (detail::ends_with(path, ".gz")) {
+        return Compression::Gzip;
+    }
+    if (detail::ends_with(path, ".zst")) {
+        return Compression::Zstd;
+    }
+    std::ifstream is(path, std::ios::binary);
+    std::array<char, 4> magic{};
+    is.read(magic.data(), magic.size());
+    return detail::detect_compression(std::string_view(magic.data(), is.gcount()));
+}
+
+/// Detects compression of a source by its first bytes, which are left to be read.
+[[nodiscard]] auto detect_compression(FdSource &source) -> Compression
+{
+    return detail::detect_compression(source.peek(4));
+}
+
+/// Stream buffer decompressing gzip or zstd data from another stream buffer.
+///
+/// Bulk reads, such as those issued by `TrecParser`, are decompressed directly
+/// into the destination buffer.
+/// If `threaded` is set, decompression runs ahead on a separate thread instead,
+/// and decompressed blocks are handed over through a short queue,
+/// so that inflating and parsing overlap.
+class DecompressingStreambuf : public std::streambuf {
+   public:
+    DecompressingStreambuf(std::streambuf *source,
+                           Compression compression = Compression::Auto,
+                           std::size_t block_size = std::size_t{1} << 20,
+                           bool threaded = false)
+        : decoder_(source, compression, block_size), block_size_(block_size)
+    {
+        if (threaded) {
+            prefetcher_.emplace(
+                [this](char *out, std::size_t size) { return decoder_.read(out, size); },
+                block_size_);
+        } else {
+            block_ = std::make_unique<char[]>(block_size_);
+        }
+    }
+    DecompressingStreambuf(DecompressingStreambuf const &) = delete;
+    DecompressingStreambuf &operator=(DecompressingStreambuf const &) = delete;
+
+   protected:
+    auto underflow() -> int_type override
+    {
+        if (gptr() == egptr() && not next_block()) {
+            return traits_type::eof();
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    auto xsgetn(char *out, std::streamsize count) -> std::streamsize override
+    {
+        std::streamsize total = 0;
+        while (total < count) {
+            if (gptr() == egptr()) {
+                if (not prefetcher_) {
+                    auto read =
+                        decoder_.read(out + total, static_cast<std::size_t>(count - total));
+                    if (read == 0) {
+                        break;
+                    }
+                    total += static_cast<std::streamsize>(read);
+                    continue;
+                }
+                if (not next_block()) {
+                    break;
+                }
+            }
+            auto available =
+                std::min(count - total, static_cast<std::streamsize>(egptr() - gptr()));
+            std::memcpy(out + total, gptr(), static_cast<std::size_t>(available));
+            gbump(static_cast<int>(available));
+            total += available;
+        }
+        return total;
+    }
+
+   private:
+    /// Makes the next block of decompressed data the get area.
+    [[nodiscard]] auto next_block() -> bool
+    {
+        char *begin = block_.get();
+        std::size_t size = 0;
+        if (prefetcher_) {
+            size = prefetcher_->next();
+            begin = prefetcher_->data();
+        } else {
+            size = decoder_.read(begin, block_size_);
+        }
+        setg(begin, begin, begin + size);
+        return size > 0;
+    }
+
+    detail::Decoder decoder_;
+    std::size_t block_size_;
+    std::unique_ptr<char[]> block_{};
+    // Declared last, so that the worker thread is stopped before the decoder is destroyed.
+    std::optional<detail::Prefetcher> prefetcher_{};
+};
+
+/// Input stream decompressing another stream; see `DecompressingStreambuf`.
+///
+/// Decompression errors are reported by throwing `std::runtime_error`
+/// rather than by silently ending the stream.
+class DecompressingIstream : public std::istream {
+   public:
+    explicit DecompressingIstream(std::istream &source,
+                                  Compression compression = Compression::Auto,
+                                  std::size_t block_size = std::size_t{1} << 20,
+                                  bool threaded = false)
+        : std::istream(nullptr), buf_(source.rdbuf(), compression, block_size, threaded)
+    {
+        rdbuf(&buf_);
+        exceptions(std::ios::badbit);
+    }
+
+   private:
+    DecompressingStreambuf buf_;
+};
+
+} // namespace trecpp
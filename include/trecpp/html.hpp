@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "trecpp.hpp"
+
+namespace trecpp {
+
+namespace detail {
+
+    [[nodiscard]] constexpr auto to_lower_ascii(char ch) -> char
+    {
+        return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch - 'A' + 'a') : ch;
+    }
+
+    [[nodiscard]] constexpr auto is_alpha_ascii(char ch) -> bool
+    {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+    }
+
+    /// Letters, digits, and all non-ASCII bytes, so that UTF-8 sequences stay in tokens.
+    [[nodiscard]] constexpr auto is_token_char(char ch) -> bool
+    {
+        return is_alpha_ascii(ch) || (ch >= '0' && ch <= '9')
+               || static_cast<unsigned char>(ch) >= 0x80U;
+    }
+
+    /// Checks if `data` continues with `prefix` (given in lowercase) at `pos`, ignoring case.
+    [[nodiscard]] auto starts_with_icase(std::string_view data,
+                                         std::size_t pos,
+                                         std::string_view prefix) -> bool
+    {
+        if (data.size() - std::min(pos, data.size()) < prefix.size()) {
+            return false;
+        }
+        for (std::size_t idx = 0; idx < prefix.size(); ++idx) {
+            if (to_lower_ascii(data[pos + idx]) != prefix[idx]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Writes the UTF-8 encoding of `code_point` to `out`, and returns its length.
+    auto encode_utf8(std::uint32_t code_point, std::array<char, 4> &out) -> std::size_t
+    {
+        if (code_point < 0x80U) {
+            out[0] = static_cast<char>(code_point);
+            return 1;
+        }
+        if (code_point < 0x800U) {
+            out[0] = static_cast<char>(0xC0U | (code_point >> 6U));
+            out[1] = static_cast<char>(0x80U | (code_point & 0x3FU));
+            return 2;
+        }
+        if (code_point < 0x10000U) {
+            out[0] = static_cast<char>(0xE0U | (code_point >> 12U));
+            out[1] = static_cast<char>(0x80U | ((code_point >> 6U) & 0x3FU));
+            out[2] = static_cast<char>(0x80U | (code_point & 0x3FU));
+            return 3;
+        }
+        out[0] = static_cast<char>(0xF0U | (code_point >> 18U));
+        out[1] = static_cast<char>(0x80U | ((code_point >> 12U) & 0x3FU));
+        out[2] = static_cast<char>(0x80U | ((code_point >> 6U) & 0x3FU));
+        out[3] = static_cast<char>(0x80U | (code_point & 0x3FU));
+        return 4;
+    }
+
+    /// Decodes the character reference beginning with `&` at `pos`.
+    /// Returns the length of the reference, and writes the decoded UTF-8 bytes to `out`
+    /// and their number to `size`; returns 0 if there is no valid reference at `pos`.
+    /// Numeric references and the most common named ones are recognized;
+    /// `&nbsp;` is decoded as a regular space.
+    [[nodiscard]] auto decode_entity(std::string_view data,
+                                     std::size_t pos,
+                                     std::array<char, 4> &out,
+                                     std::size_t &size) -> std::size_t
+    {
+        auto begin = pos + 1;
+        if (begin < data.size() && data[begin] == '#') {
+            bool hex = begin + 1 < data.size() && (data[begin + 1] == 'x' || data[begin + 1] == 'X');
+            auto digit = begin + (hex ? 2 : 1);
+            auto end = digit;
+            std::uint32_t code_point = 0;
+            for (; end < data.size() && end - digit < 8; ++end) {
+                char ch = data[end];
+                std::uint32_t value = 0;
+                if (ch >= '0' && ch <= '9') {
+                    value = ch - '0';
+                } else if (hex && to_lower_ascii(ch) >= 'a' && to_lower_ascii(ch) <= 'f') {
+                    value = to_lower_ascii(ch) - 'a' + 10;
+                } else {
+                    break;
+                }
+                code_point = code_point * (hex ? 16U : 10U) + value;
+            }
+            if (end == digit || code_point == 0 || code_point > 0x10FFFFU
+                || (code_point >= 0xD800U && code_point < 0xE000U)) {
+                return 0;
+            }
+            size = encode_utf8(code_point, out);
+            if (end < data.size() && data[end] == ';') {
+                ++end;
+            }
+            return end - pos;
+        }
+        static constexpr std::array<std::pair<std::string_view, std::uint32_t>, 17> entities{{
+            {"amp", '&'},        {"lt", '<'},         {"gt", '>'},         {"quot", '"'},
+            {"apos", '\''},      {"nbsp", ' '},       {"copy", 0xA9U},     {"reg", 0xAEU},
+            {"shy", 0xADU},      {"ndash", 0x2013U},  {"mdash", 0x2014U},  {"lsquo", 0x2018U},
+            {"rsquo", 0x2019U},  {"ldquo", 0x201CU},  {"rdquo", 0x201DU},  {"hellip", 0x2026U},
+            {"middot", 0xB7U},
+        }};
+        auto semicolon = data.substr(begin, 8).find(';');
+        if (semicolon == std::string_view::npos) {
+            return 0;
+        }
+        auto name = data.substr(begin, semicolon);
+        for (auto const &[entity, code_point] : entities) {
+            if (name == entity) {
+                size = encode_utf8(code_point, out);
+                return name.size() + 2;
+            }
+        }
+        return 0;
+    }
+
+    /// Returns the position right after the `>` closing the tag that begins at `pos`,
+    /// skipping over quoted attribute values, or the size of `data` if it is not closed.
+    [[nodiscard]] auto skip_tag(std::string_view data, std::size_t pos) -> std::size_t
+    {
+        char quote = '\0';
+        for (++pos; pos < data.size(); ++pos) {
+            char ch = data[pos];
+            if (quote != '\0') {
+                if (ch == quote) {
+                    quote = '\0';
+                }
+            } else if (ch == '"' || ch == '\'') {
+                quote = ch;
+            } else if (ch == '>') {
+                return pos + 1;
+            }
+        }
+        return data.size();
+    }
+
+    /// Returns the position right after the end tag `</name>` at or after `pos`,
+    /// ignoring case, or the size of `data` if there is none.
+    [[nodiscard]] auto skip_to_end_tag(std::string_view data,
+                                       std::size_t pos,
+                                       std::string_view name) -> std::size_t
+    {
+        while ((pos = find_tag(data, "</", pos)) != std::string_view::npos) {
+            if (starts_with_icase(data, pos + 2, name)) {
+                return skip_tag(data, pos);
+            }
+            pos += 2;
+        }
+        return data.size();
+    }
+
+} // namespace detail
+
+namespace html {
+
+    /// Extracts the text of an HTML document in a single pass,
+    /// calling `sink(std::string_view)` with consecutive pieces of it.
+    ///
+    /// Comments are removed, the contents of `<script>` and `<style>` elements too,
+    /// and every other tag is replaced by a space. Character references are decoded.
+    /// Pieces of text point into `html` where possible, and are valid only during the call.
+    template <typename Sink>
+    void extract_text(std::string_view html, Sink &&sink)
+    {
+        auto const &scanner = trecpp::detail::scan::scanner();
+        std::array<char, 4> decoded{};
+        std::size_t pos = 0;
+        std::size_t text_begin = 0;
+        auto flush = [&](std::size_t end) {
+            if (end > text_begin) {
+                sink(html.substr(text_begin, end - text_begin));
+            }
+        };
+        while (pos < html.size()) {
+            // Text, including whitespace and control characters, is passed on in whole spans.
+            pos += scanner.find_either(html.data() + pos, html.size() - pos, '<', '&');
+            if (pos == html.size()) {
+                break;
+            }
+            if (html[pos] == '&') {
+                std::size_t size = 0;
+                if (auto length = trecpp::detail::decode_entity(html, pos, decoded, size);
+                    length > 0) {
+                    flush(pos);
+                    sink(std::string_view(decoded.data(), size));
+                    pos += length;
+                    text_begin = pos;
+                } else {
+                    ++pos;
+                }
+                continue;
+            }
+            auto next = pos + 1 < html.size() ? html[pos + 1] : '\0';
+            if (html.substr(pos, 4) == "<!--") {
+                flush(pos);
+                auto end = html.find("-->", pos + 4);
+                pos = end == std::string_view::npos ? html.size() : end + 3;
+                text_begin = pos;
+                continue;
+            }
+            if (not trecpp::detail::is_alpha_ascii(next) && next != '/' && next != '!'
+                && next != '?') {
+                ++pos;
+                continue;
+            }
+            flush(pos);
+            auto end = trecpp::detail::skip_tag(html, pos);
+            for (std::string_view raw_text : {"script", "style"}) {
+                if (trecpp::detail::starts_with_icase(html, pos + 1, raw_text)
+                    && not trecpp::detail::is_token_char(
+                        pos + 1 + raw_text.size() < html.size() ? html[pos + 1 + raw_text.size()]
+                                                                : '\0')) {
+                    end = trecpp::detail::skip_to_end_tag(html, end, raw_text);
+                    break;
+                }
+            }
+            sink(std::string_view(" "));
+            pos = end;
+            text_begin = pos;
+        }
+        flush(html.size());
+    }
+
+    /// Splits text into tokens: maximal runs of ASCII letters and digits and non-ASCII bytes,
+    /// with ASCII letters lowercased.
+    ///
+    /// Text can be fed in pieces, such as those produced by `extract_text`,
+    /// and a token can span several pieces.
+    /// Tokens are passed to `sink(std::string_view)`, and are valid only during the call.
+    class Tokenizer {
+       public:
+        template <typename Sink>
+        void feed(std::string_view text, Sink &&sink)
+        {
+            std::size_t pos = 0;
+            while (pos < text.size()) {
+                auto begin = pos;
+                while (pos < text.size() && trecpp::detail::is_token_char(text[pos])) {
+                    ++pos;
+                }
+                auto part = text.substr(begin, pos - begin);
+                if (pos == text.size()) {
+                    append(part);
+                    return;
+                }
+                if (token_.empty() && not part.empty() && is_lowercase(part)) {
+                    sink(part);
+                } else if (not token_.empty() || not part.empty()) {
+                    append(part);
+                    sink(std::string_view(token_));
+                    token_.clear();
+                }
+                while (pos < text.size() && not trecpp::detail::is_token_char(text[pos])) {
+                    ++pos;
+                }
+            }
+        }
+
+        /// Emits the last token, if any.
+        template <typename Sink>
+        void finish(Sink &&sink)
+        {
+            if (not token_.empty()) {
+                sink(std::string_view(token_));
+                token_.clear();
+            }
+        }
+
+        /// Tokenizes the text of an HTML document; see `extract_text`.
+        template <typename Sink>
+        void tokenize(std::string_view html, Sink &&sink)
+        {
+            extract_text(html, [&](std::string_view text) { feed(text, sink); });
+            finish(sink);
+        }
+
+       private:
+        [[nodiscard]] static auto is_lowercase(std::string_view token) -> bool
+        {
+            return std::none_of(
+                token.begin(), token.end(), [](char ch) { return ch >= 'A' && ch <= 'Z'; });
+        }
+
+        void append(std::string_view part)
+        {
+            std::transform(
+                part.begin(), part.end(), std::back_inserter(token_), trecpp::detail::to_lower_ascii);
+        }
+
+        std::string token_;
+    };
+
+    /// Tokenizes the text of an HTML document in a single pass; see `Tokenizer`.
+    template <typename Sink>
+    void tokenize(std::string_view html, Sink &&sink)
+    {
+        Tokenizer tokenizer;
+        tokenizer.tokenize(html, sink);
+    }
+
+    /// Appends the text of an HTML document to `out`, with whitespace collapsed
+    /// to single spaces and trimmed; see `extract_text`.
+    void strip(std::string_view html, std::string &out)
+    {
+        bool space = false;
+        auto begin = out.size();
+        extract_text(html, [&](std::string_view text) {
+            std::size_t pos = 0;
+            while (pos < text.size()) {
+                auto word = trecpp::detail::skip_ws(text, pos);
+                space = space || word > pos;
+                if (word == text.size()) {
+                    break;
+                }
+                pos = trecpp::detail::skip_to_ws(text, word);
+                if (space && out.size() > begin) {
+                    out.push_back(' ');
+                }
+                space = false;
+                out.append(text.substr(word, pos - word));
+            }
+        });
+    }
+
+} // namespace html
+
+} // namespace trecpp
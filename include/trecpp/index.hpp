@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "trecpp.hpp"
+
+namespace trecpp {
+
+/// Position of a record in a collection file, from `<DOC>` to the end of `</DOC>`.
+struct RecordLocation {
+    std::uint64_t offset;
+    std::uint64_t length;
+};
+
+/// Sidecar index of a collection file, mapping docnos and ordinals to record locations.
+///
+/// Ordinals count the records that could be parsed, in the order of the file,
+/// which is the order in which the parsers return them.
+/// Docnos are kept sorted (as a permutation of ordinals) and looked up by binary search.
+class RecordIndex {
+   public:
+    /// Indexes all records in `data`, in trectext format if `text` is `true`,
+    /// or else in trecweb format, where records end according to `framing`.
+    /// Records that cannot be parsed are skipped.
+    [[nodiscard]] static auto build(std::string_view data,
+                                    bool text,
+                                    web::Framing framing = web::Framing::Scan) -> RecordIndex
+    {
+        // Records are fully validated, so that the ordinals match the parsers,
+        // but trectext content is not copied.
+        RecordIndex index;
+        if (text) {
+            detail::TextFields fields;
+            std::size_t pos = detail::find_tag(data, detail::DOC, 0);
+            while (pos != std::string_view::npos) {
+                auto begin = pos;
+                if (detail::parse_text(data, pos, true, fields, 0, Fields::Docno | Fields::Url)
+                    == detail::ParseStatus::Parsed) {
+                    index.push_back(fields.docno, RecordLocation{begin, pos - begin});
+                }
+                pos = detail::find_tag(data, detail::DOC, pos);
+            }
+        } else {
+            ParseError error;
+            std::size_t pos = 0;
+            while (auto view = detail::next_record(data, pos, framing)) {
+                auto record = detail::parse_web(*view, error, Fields::All, framing);
+                if (not record) {
+                    continue;
+                }
+                // The parsers accept a record without `<DOC>`, which is then indexed whole.
+                auto begin = detail::find_tag(*view, detail::DOC, 0);
+                if (begin == std::string_view::npos) {
+                    begin = detail::skip_ws(*view, 0);
+                }
+                index.push_back(record->trecid(),
+                                RecordLocation{pos - view->size() + begin, view->size() - begin});
+            }
+        }
+        index.sort();
+        return index;
+    }
+
+    /// Reads an index written by `write`.
+    /// Throws `std::runtime_error` if the input is not a valid index.
+    [[nodiscard]] static auto read(std::istream &is) -> RecordIndex
+    {
+        std::string magic(MAGIC.size(), '\0');
+        is.read(magic.data(), magic.size());
+        std::uint64_t count = 0;
+        std::uint64_t docnos_size = 0;
+        read_values(is, &count, 1);
+        read_values(is, &docnos_size, 1);
+        if (not is or magic != MAGIC) {
+            throw std::runtime_error("Invalid index file");
+        }
+        RecordIndex index;
+        read_values(is, index.locations_, count);
+        read_values(is, index.docno_offsets_, count + 1);
+        read_values(is, index.sorted_, count);
+        read_values(is, index.docnos_, docnos_size);
+        if (not is or index.docno_offsets_.back() != docnos_size
+            or not std::is_sorted(index.docno_offsets_.begin(), index.docno_offsets_.end())
+            or std::any_of(index.sorted_.begin(), index.sorted_.end(), [&](auto ordinal) {
+                   return ordinal >= count;
+               })) {
+            throw std::runtime_error("Invalid index file");
+        }
+        return index;
+    }
+
+    /// Writes the index in a binary format, in native byte order.
+    void write(std::ostream &os) const
+    {
+        std::uint64_t count = size();
+        std::uint64_t docnos_size = docnos_.size();
+        os.write(MAGIC.data(), MAGIC.size());
+        write_values(os, &count, 1);
+        write_values(os, &docnos_size, 1);
+        write_values(os, locations_.data(), locations_.size());
+        write_values(os, docno_offsets_.data(), docno_offsets_.size());
+        write_values(os, sorted_.data(), sorted_.size());
+        os.write(docnos_.data(), docnos_.size());
+    }
+
+    [[nodiscard]] static auto load(std::string const &path) -> RecordIndex
+    {
+        std::ifstream is(path, std::ios::binary);
+        if (not is) {
+            throw std::runtime_error("Unable to open " + path);
+        }
+        return read(is);
+    }
+
+    void save(std::string const &path) const
+    {
+        std::ofstream os(path, std::ios::binary);
+        write(os);
+        if (not os) {
+            throw std::runtime_error("Unable to write " + path);
+        }
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t { return locations_.size(); }
+    [[nodiscard]] auto location(std::size_t ordinal) const -> RecordLocation
+    {
+        return locations_[ordinal];
+    }
+    [[nodiscard]] auto docno(std::size_t ordinal) const -> std::string_view
+    {
+        return std::string_view(docnos_).substr(
+            docno_offsets_[ordinal], docno_offsets_[ordinal + 1] - docno_offsets_[ordinal]);
+    }
+
+    /// Returns the ordinal of the first record with `docno`, if any.
+    [[nodiscard]] auto find(std::string_view docno) const -> std::optional<std::size_t>
+    {
+        auto pos = std::lower_bound(
+            sorted_.begin(), sorted_.end(), docno, [&](std::uint64_t ordinal, auto const &value) {
+                return this->docno(ordinal) < value;
+            });
+        if (pos == sorted_.end() or this->docno(*pos) != docno) {
+            return std::nullopt;
+        }
+        return *pos;
+    }
+
+   private:
+    static constexpr std::string_view MAGIC = "TRECIDX1";
+
+    template <typename T>
+    static void read_values(std::istream &is, T *values, std::size_t count)
+    {
+        is.read(reinterpret_cast<char *>(values), count * sizeof(T));
+    }
+
+    /// Reads `count` values into `values` in bounded chunks, so that the sizes read from
+    /// a truncated or corrupt file fail at the end of the input instead of being allocated.
+    template <typename Container>
+    static void read_values(std::istream &is, Container &values, std::uint64_t count)
+    {
+        constexpr std::uint64_t chunk_size = std::uint64_t{1} << 16;
+        values.clear();
+        while (values.size() < count and is) {
+            auto size = values.size();
+            values.resize(size + std::min(chunk_size, count - size));
+            read_values(is, values.data() + size, values.size() - size);
+        }
+    }
+
+    template <typename T>
+    static void write_values(std::ostream &os, T const *values, std::size_t count)
+    {
+        os.write(reinterpret_cast<char const *>(values), count * sizeof(T));
+    }
+
+    void push_back(std::string_view docno, RecordLocation location)
+    {
+        locations_.push_back(location);
+        docnos_.append(docno);
+        docno_offsets_.push_back(docnos_.size());
+    }
+
+    void sort()
+    {
+        sorted_.resize(size());
+        std::iota(sorted_.begin(), sorted_.end(), 0);
+        std::stable_sort(sorted_.begin(), sorted_.end(), [&](auto lhs, auto rhs) {
+            return docno(lhs) < docno(rhs);
+        });
+    }
+
+    std::vector<RecordLocation> locations_;
+    std::vector<std::uint64_t> docno_offsets_{0};
+    std::vector<std::uint64_t> sorted_;
+    std::string docnos_;
+};
+
+/// Returns the path of the sidecar index of the collection at `path`.
+[[nodiscard]] auto index_path(std::string const &path) -> std::string { return path + ".idx"; }
+
+/// Uncompressed collection file with random access to its records through a `RecordIndex`.
+///
+/// Fetched records are views into a memory mapping of the file, to be passed on
+/// to `web::parse` or `text::parse`, and are valid for the lifetime of the collection.
+class IndexedCollection {
+   public:
+    /// Opens the collection at `path` with its sidecar index (see `index_path`).
+    explicit IndexedCollection(std::string const &path)
+        : IndexedCollection(path, RecordIndex::load(index_path(path)))
+    {
+    }
+    /// Throws `std::runtime_error` if `index` points outside of the file.
+    IndexedCollection(std::string const &path, RecordIndex index)
+        : file_(path, MappedFile::Access::Random), index_(std::move(index))
+    {
+        for (std::size_t ordinal = 0; ordinal < index_.size(); ++ordinal) {
+            auto location = index_.location(ordinal);
+            if (location.offset > file_.size()
+                or location.length > file_.size() - location.offset) {
+                throw std::runtime_error("Index does not match collection " + path);
+            }
+        }
+    }
+
+    [[nodiscard]] auto index() const -> RecordIndex const & { return index_; }
+
+    [[nodiscard]] auto fetch(std::size_t ordinal) const -> std::string_view
+    {
+        auto location = index_.location(ordinal);
+        return file_.data().substr(location.offset, location.length);
+    }
+    [[nodiscard]] auto fetch(std::string_view docno) const -> std::optional<std::string_view>
+    {
+        if (auto ordinal = index_.find(docno); ordinal) {
+            return fetch(*ordinal);
+        }
+        return std::nullopt;
+    }
+
+   private:
+    MappedFile file_;
+    RecordIndex index_;
+};
+
+} // namespace trecpp
@@ -1,375 +1,3460 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
 #include <istream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <ostream>
+#include <sstream>
+#include <streambuf>
 #include <string>
 #include <string_view>
-#include <unordered_set>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <variant>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 namespace trecpp {
 
 struct Error {
     std::string msg;
 };
-class Record;
-using Result = std::variant<Record, Error>;
 
-class Record {
-   private:
-    std::string docno_;
-    std::string url_;
-    std::string content_;
+/// Record fields, combined with `|` into a projection of the fields to extract.
+///
+/// Fields outside of the projection are left empty, and the parsers do not look for them,
+/// so errors in the skipped parts of a record go unreported.
+/// The docno delimits records, and is always extracted.
+/// `Header` is the HTTP header of a trecweb record, which only `RecordView` carries.
+enum class Fields : std::uint8_t {
+    Docno = 1U,
+    Url = 2U,
+    Content = 4U,
+    Header = 8U,
+    All = 15U,
+};
 
-   public:
-    Record(std::string docno, std::string url, std::string content)
-        : docno_(std::move(docno)), url_(std::move(url)), content_(std::move(content))
-    {}
-    [[nodiscard]] auto content_length() const -> std::size_t { return content_.size(); }
-    [[nodiscard]] auto content() -> std::string && { return std::move(content_); }
-    [[nodiscard]] auto content() const -> std::string const & { return content_; }
-    [[nodiscard]] auto url() const -> std::string const & { return url_; }
-    [[nodiscard]] auto url() -> std::string && { return std::move(url_); }
-    [[nodiscard]] auto trecid() const -> std::string const & { return docno_; }
-    [[nodiscard]] auto trecid() -> std::string && { return std::move(docno_); }
+[[nodiscard]] constexpr auto operator|(Fields lhs, Fields rhs) -> Fields
+{
+    return static_cast<Fields>(static_cast<std::uint8_t>(lhs) | static_cast<std::uint8_t>(rhs));
+}
 
-    friend std::ostream &operator<<(std::ostream &os, Record const &record);
-};
+/// Returns `true` if `field` is part of `projection`.
+[[nodiscard]] constexpr auto has(Fields projection, Fields field) -> bool
+{
+    return (static_cast<std::uint8_t>(projection) & static_cast<std::uint8_t>(field)) != 0U;
+}
 
-namespace detail {
+/// Kind of a parsing error.
+enum class ErrorCode : std::uint8_t {
+    MissingDoc,
+    MissingDocno,
+    MissingDocnoEnd,
+    MissingDochdr,
+    MissingDochdrEnd,
+    MissingTag,
+    MissingClosingTag,
+    UnterminatedRecord,
+    /// The record is larger than the limit set with `set_max_record_size`.
+    OversizeRecord,
+};
 
-    static std::string const DOC = "<DOC>";
-    static std::string const DOC_END = "</DOC>";
-    static std::string const DOCNO = "<DOCNO>";
-    static std::string const DOCNO_END = "</DOCNO>";
-    static std::string const DOCHDR = "<DOCHDR>";
-    static std::string const DOCHDR_END = "</DOCHDR>";
-    static std::string const URL = "<URL>";
-    static std::string const URL_END = "</URL>";
+/// Parsing error that can be reported without allocating.
+///
+/// `offset` is the position of the error in the input.
+/// `tag` (the name of an unclosed tag) and `context` point into the parsed data.
+/// The message is only formatted on request, and is the same as in the corresponding `Error`.
+struct ParseError {
+    ErrorCode code = ErrorCode::MissingDoc;
+    std::size_t offset = 0;
+    std::string_view tag{};
+    std::string_view context{};
 
-    [[nodiscard]] auto skip_ws(std::string_view const &data, std::size_t pos) -> std::size_t
+    [[nodiscard]] auto message() const -> std::string
     {
-        auto it = std::find_if(
-            &data[pos], &data[data.size()], [](unsigned char ch) { return !std::isspace(ch); });
-        return pos + std::distance(&data[pos], it);
+        std::string expected;
+        switch (code) {
+        case ErrorCode::MissingDoc:
+            expected = "<DOC>";
+            break;
+        case ErrorCode::MissingDocno:
+            expected = "<DOCNO>";
+            break;
+        case ErrorCode::MissingDocnoEnd:
+            expected = "</DOCNO>";
+            break;
+        case ErrorCode::MissingDochdr:
+            expected = "<DOCHDR>";
+            break;
+        case ErrorCode::MissingDochdrEnd:
+            expected = "</DOCHDR>";
+            break;
+        case ErrorCode::MissingTag:
+            expected = "any tag ";
+            break;
+        case ErrorCode::MissingClosingTag:
+            expected = "</" + std::string(tag) + ">";
+            break;
+        case ErrorCode::UnterminatedRecord:
+            return "Unterminated record in context: " + std::string(context);
+        case ErrorCode::OversizeRecord:
+            return "Oversize record in context: " + std::string(context);
+        }
+        return "Could not consume " + expected + " in context: " + std::string(context);
+    }
+    [[nodiscard]] auto to_error() const -> Error { return Error{message()}; }
+};
+
+/// Returns the name of `code` in snake case, such as `missing_docno`.
+[[nodiscard]] constexpr auto error_code_name(ErrorCode code) -> std::string_view
+{
+    switch (code) {
+    case ErrorCode::MissingDoc:
+        return "missing_doc";
+    case ErrorCode::MissingDocno:
+        return "missing_docno";
+    case ErrorCode::MissingDocnoEnd:
+        return "missing_docno_end";
+    case ErrorCode::MissingDochdr:
+        return "missing_dochdr";
+    case ErrorCode::MissingDochdrEnd:
+        return "missing_dochdr_end";
+    case ErrorCode::MissingTag:
+        return "missing_tag";
+    case ErrorCode::MissingClosingTag:
+        return "missing_closing_tag";
+    case ErrorCode::UnterminatedRecord:
+        return "unterminated_record";
+    case ErrorCode::OversizeRecord:
+        return "oversize_record";
     }
+    return "unknown";
+}
 
-    [[nodiscard]] auto skip_to_ws(std::string_view const &data, std::size_t pos) -> std::size_t
+/// Statistics of the buffered parsers, collected when they are given a `ParseStats`
+/// (see `set_stats`).
+///
+/// The time spent in the parser is split into phases, which are exclusive: reading the input
+/// while looking for a delimiter counts as I/O only. Time spent outside of the parser,
+/// such as in callbacks, counts as `Phase::Other`. Switching phases reads the clock,
+/// which costs nothing when no statistics are collected.
+class ParseStats {
+   public:
+    enum class Phase : std::uint8_t {
+        /// Waiting for the input stream.
+        Io,
+        /// Scanning the buffer for record delimiters.
+        Scan,
+        /// Parsing fields out of a delimited record.
+        Parse,
+        /// Copying fields into owned strings.
+        Copy,
+        /// Outside of the parser.
+        Other,
+    };
+    static constexpr std::size_t PHASES = 5;
+    static constexpr std::size_t ERROR_CODES =
+        static_cast<std::size_t>(ErrorCode::OversizeRecord) + 1;
+
+    std::uint64_t bytes_read = 0;
+    std::uint64_t records = 0;
+    std::array<std::uint64_t, ERROR_CODES> errors{};
+    /// Number of times the read buffer was reallocated to fit a larger record.
+    std::uint64_t buffer_growths = 0;
+    std::uint64_t largest_record = 0;
+    std::array<std::chrono::nanoseconds, PHASES> time{};
+
+    [[nodiscard]] auto error_count() const -> std::uint64_t
+    {
+        std::uint64_t count = 0;
+        for (auto errors_with_code : errors) {
+            count += errors_with_code;
+        }
+        return count;
+    }
+    [[nodiscard]] auto time_in(Phase phase) const -> std::chrono::nanoseconds
     {
-        auto it = std::find_if(
-            &data[pos], &data[data.size()], [](unsigned char ch) { return std::isspace(ch); });
-        return pos + std::distance(&data[pos], it);
+        return time[static_cast<std::size_t>(phase)];
     }
 
-    [[nodiscard]] auto read_between(std::string_view const &data, std::size_t &pos)
+    void count_record(std::size_t size)
     {
-        return [&](auto const &open, auto const &close) -> std::optional<std::string_view> {
-            auto begin = data.find(open, pos);
-            if (begin == std::string_view::npos) {
-                return std::nullopt;
-            } else {
-                begin += open.size();
-            }
-            auto end = data.find(close, begin);
-            if (end == std::string_view::npos) {
-                return std::nullopt;
-            }
-            pos = end;
-            return std::string_view(&data[begin], end - begin);
-        };
+        ++records;
+        largest_record = std::max<std::uint64_t>(largest_record, size);
     }
+    void count_error(ErrorCode code) { ++errors[static_cast<std::size_t>(code)]; }
 
-    [[nodiscard]] auto consumer(std::string_view &data, std::size_t &pos)
+    /// Adds the time since the last switch to the current phase, and switches to `phase`.
+    /// Returns the previous phase.
+    auto enter(Phase phase) -> Phase
     {
-        return [&](auto const &tag) {
-            pos = skip_ws(data, pos);
-            auto tag_len = tag.size();
-            if (pos + tag_len < pos && data.substr(pos, tag_len) == tag) {
-                pos += tag_len;
-                return true;
-            } else {
-                return false;
-            }
-        };
+        auto now = std::chrono::steady_clock::now();
+        time[static_cast<std::size_t>(phase_)] += now - since_;
+        since_ = now;
+        return std::exchange(phase_, phase);
     }
 
-    bool consume(std::istream &is, std::string const &token)
+    /// Adds the counters and times of `other`.
+    void merge(ParseStats const &other)
     {
-        is >> std::ws;
-        for (auto pos = token.begin(); pos != token.end(); ++pos) {
-            if (is.get() != *pos) {
-                is.unget();
-                for (auto rpos = std::reverse_iterator(pos); rpos != token.rend(); ++rpos) {
-                    is.putback(*rpos);
-                }
-                return false;
-            }
+        bytes_read += other.bytes_read;
+        records += other.records;
+        for (std::size_t code = 0; code < ERROR_CODES; ++code) {
+            errors[code] += other.errors[code];
+        }
+        buffer_growths += other.buffer_growths;
+        largest_record = std::max(largest_record, other.largest_record);
+        for (std::size_t phase = 0; phase < PHASES; ++phase) {
+            time[phase] += other.time[phase];
         }
-        return true;
     }
 
-    template <typename Pred>
-    std::ostream& read_until(std::istream &is, Pred pred, std::ostream& os)
+    /// Returns the statistics collected so far, and resets them,
+    /// but keeps timing the current phase.
+    [[nodiscard]] auto take() -> ParseStats
     {
-        while (not is.eof()) {
-            if (is.peek() == std::istream::traits_type::eof() or pred(is.peek())) {
-                break;
-            }
-            os.put(is.get());
+        enter(phase_);
+        ParseStats taken = *this;
+        *this = ParseStats{};
+        phase_ = taken.phase_;
+        since_ = taken.since_;
+        return taken;
+    }
+
+    /// Writes the statistics as a single-line JSON object.
+    void write_json(std::ostream &os) const
+    {
+        os << "{\"bytes_read\":" << bytes_read << ",\"records\":" << records
+           << ",\"errors\":" << error_count() << ",\"errors_by_code\":{";
+        for (std::size_t code = 0; code < ERROR_CODES; ++code) {
+            os << (code > 0 ? ",\"" : "\"") << error_code_name(static_cast<ErrorCode>(code))
+               << "\":" << errors[code];
         }
-        return os;
+        os << "},\"buffer_growths\":" << buffer_growths
+           << ",\"largest_record\":" << largest_record << ",\"seconds\":{";
+        static constexpr std::array<std::string_view, PHASES> names = {
+            "io", "scan", "parse", "copy", "other"};
+        for (std::size_t phase = 0; phase < PHASES; ++phase) {
+            os << (phase > 0 ? ",\"" : "\"") << names[phase]
+               << "\":" << std::chrono::duration<double>(time[phase]).count();
+        }
+        os << "}}";
     }
 
-    template <typename Pred>
-    std::string read_until(std::istream &is, Pred pred)
+   private:
+    Phase phase_ = Phase::Other;
+    std::chrono::steady_clock::time_point since_ = std::chrono::steady_clock::now();
+};
+/// HTTP header of a trecweb record: the contents of `<DOCHDR>` following the URL.
+///
+/// Nothing is parsed up front: each accessor scans the (short) header when it is called.
+/// Values point into the parsed data.
+class HttpHeader {
+   public:
+    HttpHeader() = default;
+    explicit HttpHeader(std::string_view data) : data_(data) {}
+
+    /// Returns the raw header.
+    [[nodiscard]] auto data() const -> std::string_view { return data_; }
+    [[nodiscard]] auto empty() const -> bool { return data_.empty(); }
+
+    /// Returns the status line, such as `HTTP/1.1 200 OK`, or an empty view if there is none.
+    [[nodiscard]] auto status_line() const -> std::string_view
     {
-        std::ostringstream os;
-        read_until(is, pred, os);
-        return os.str();
+        std::size_t pos = 0;
+        while (pos < data_.size()) {
+            auto line = next_line(pos);
+            if (line.substr(0, 5) == "HTTP/") {
+                return line;
+            }
+            if (not line.empty()) {
+                break;
+            }
+        }
+        return {};
     }
 
-    std::optional<std::string> consume(std::istream &is)
+    /// Returns the status code from the status line, if any.
+    [[nodiscard]] auto status_code() const -> std::optional<int>
     {
-        is >> std::ws;
-        if (is.peek() == std::istream::traits_type::eof() or is.peek() != '<') {
+        auto line = status_line();
+        auto space = line.find(' ');
+        if (space == std::string_view::npos) {
             return std::nullopt;
         }
-        is.ignore(1);
-        auto tag = read_until(is, [](char ch) { return ch == '>'; });
-        if (is.peek() == '>') {
-            is.ignore(1);
-            auto first_whitespace = std::find_if(
-                tag.begin(), tag.end(), [](unsigned char ch) { return std::isspace(ch); });
-            auto size = std::distance(tag.begin(), first_whitespace);
-            tag.resize(size);
-            return std::make_optional(tag);
+        auto code = parse_number(trim(line.substr(space + 1, 4)));
+        if (not code or *code > 999) {
+            return std::nullopt;
         }
-        return std::nullopt;
+        return static_cast<int>(*code);
     }
 
-    std::optional<std::string> read_body(std::istream &is, std::string const &closing_tag)
+    /// Returns the value of the first field called `name` (ignoring case), without
+    /// surrounding whitespace, or `std::nullopt` if there is no such field.
+    [[nodiscard]] auto field(std::string_view name) const -> std::optional<std::string_view>
     {
-        std::ostringstream os;
-        while (read_until(is, [](auto ch) { return ch == '<'; }, os)) {
-            if (is.peek() == std::istream::traits_type::eof()) {
-                break;
-            }
-            if (consume(is, closing_tag)) {
-                return std::make_optional(os.str());
+        std::size_t pos = 0;
+        while (pos < data_.size()) {
+            auto line = next_line(pos);
+            if (line.size() > name.size() and line[name.size()] == ':'
+                and equal_icase(line.substr(0, name.size()), name)) {
+                return trim(line.substr(name.size() + 1));
             }
-            os.put(is.get());
         }
         return std::nullopt;
     }
 
-    std::string_view read_token(std::string_view const &data, std::size_t &pos)
+    /// Returns the media type of `Content-Type`, such as `text/html`, without parameters.
+    [[nodiscard]] auto content_type() const -> std::string_view
     {
-        pos = skip_ws(data, pos);
-        auto first = pos;
-        pos = skip_to_ws(data, pos + 1);
-        return std::string_view(&data[first], pos - first);
+        auto value = field("Content-Type").value_or(std::string_view{});
+        return trim(value.substr(0, value.find(';')));
     }
 
-    std::string read_token(std::istream &is)
+    /// Returns the `charset` parameter of `Content-Type`, without quotes.
+    [[nodiscard]] auto charset() const -> std::string_view
     {
-        return read_until(is, [](char c) { return c == '<' || std::isspace(c); });
+        auto value = field("Content-Type").value_or(std::string_view{});
+        auto pos = value.find(';');
+        while (pos != std::string_view::npos) {
+            auto end = value.find(';', pos + 1);
+            auto parameter = trim(
+                value.substr(pos + 1, end == std::string_view::npos ? end : end - pos - 1));
+            if (parameter.size() > 8 and equal_icase(parameter.substr(0, 8), "charset=")) {
+                auto charset = parameter.substr(8);
+                if (charset.size() >= 2 and charset.front() == '"' and charset.back() == '"') {
+                    charset = charset.substr(1, charset.size() - 2);
+                }
+                return charset;
+            }
+            pos = end;
+        }
+        return {};
     }
 
-    template <class ReadRecord>
-    [[nodiscard]] auto read_subsequent_record(std::istream &is, ReadRecord read_record) -> Result
+    /// Returns the value of `Content-Length`, if it is a valid number.
+    [[nodiscard]] auto content_length() const -> std::optional<std::size_t>
     {
-        is.ignore(std::numeric_limits<std::streamsize>::max(), '<');
-        if (is.eof()) {
-            return Error{"EOF"};
-        }
-        is.putback('<');
-        while (not is.eof() and not detail::consume(is, detail::DOC)) {
-            is.ignore(1);
-            is.ignore(std::numeric_limits<std::streamsize>::max(), '<');
-            is.putback('<');
-        }
-        if (not is.eof()) {
-            for (auto pos = detail::DOC.rbegin(); pos != detail::DOC.rend(); ++pos) {
-                is.putback(*pos);
-            }
-            return read_record(is);
+        if (auto value = field("Content-Length"); value) {
+            return parse_number(*value);
         }
-        return Error{"EOF"};
+        return std::nullopt;
     }
 
-    [[nodiscard]] auto closing_tag(std::string const &tag) -> std::string
+    [[nodiscard]] auto last_modified() const -> std::optional<std::string_view>
     {
-        std::string ct;
-        ct.reserve(tag.size() + 3);
-        ct.push_back('<');
-        ct.push_back('/');
-        std::copy(tag.begin(), tag.end(), std::back_inserter(ct));
-        ct.push_back('>');
-        return ct;
+        return field("Last-Modified");
     }
 
-} // namespace detail
+   private:
+    /// Returns the line starting at `pos` without its line break, and moves `pos` past it.
+    [[nodiscard]] auto next_line(std::size_t &pos) const -> std::string_view
+    {
+        auto end = std::min(data_.find('\n', pos), data_.size());
+        auto line = data_.substr(pos, end - pos);
+        pos = end + 1;
+        if (not line.empty() and line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        return line;
+    }
 
-template <typename R, typename Record_Handler, typename Error_Handler>
-auto match(R &&result, Record_Handler &&record_handler, Error_Handler &&error_handler)
-{
-    if (auto *record = std::get_if<Record>(&result); record != nullptr) {
-        if constexpr (std::is_same_v<decltype(record_handler(*record)), void>) {
-            record_handler(*record);
-        } else {
-            return record_handler(*record);
+    [[nodiscard]] static auto trim(std::string_view value) -> std::string_view
+    {
+        while (not value.empty() and (value.front() == ' ' or value.front() == '\t')) {
+            value.remove_prefix(1);
         }
-    } else {
-        auto *error = std::get_if<Error>(&result);
-        if constexpr (std::is_same_v<decltype(error_handler(*error)), void>) {
-            error_handler(*error);
-        } else {
-            return error_handler(*error);
+        while (not value.empty() and (value.back() == ' ' or value.back() == '\t')) {
+            value.remove_suffix(1);
         }
+        return value;
     }
-}
-
-constexpr bool holds_record(Result const &result) { return std::holds_alternative<Record>(result); }
 
-[[nodiscard]] auto consume_error(std::string const &tag, std::istream &is) -> Error
-{
-    std::string context;
-    std::getline(is, context);
-    auto error = Error{"Could not consume " + tag + " in context: " + context};
-    is.putback('\n');
-    for (auto pos = context.rbegin(); pos != context.rend(); ++pos) {
-        is.putback(*pos);
+    [[nodiscard]] static auto equal_icase(std::string_view lhs, std::string_view rhs) -> bool
+    {
+        auto lower = [](char ch) { return ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch; };
+        return lhs.size() == rhs.size()
+               and std::equal(lhs.begin(), lhs.end(), rhs.begin(), [&](char a, char b) {
+                       return lower(a) == lower(b);
+                   });
     }
-    return error;
-}
 
-namespace text {
-
-    static const std::unordered_set<std::string> content_tags = {
-        "TEXT", "HEADLINE", "TITLE", "HL", "HEAD", "TTL", "DD", "DATE", "LP", "LEADPARA"};
-
-    [[nodiscard]] auto read_record(std::istream &is) -> Result
+    [[nodiscard]] static auto parse_number(std::string_view digits) -> std::optional<std::size_t>
     {
-        if (not detail::consume(is, detail::DOC)) {
-            return consume_error(detail::DOC, is);
-        }
-        if (not detail::consume(is, detail::DOCNO)) {
-            return consume_error(detail::DOCNO, is);
-        }
-        is >> std::ws;
-        auto docno = detail::read_token(is);
-        is >> std::ws;
-        if (not detail::consume(is, detail::DOCNO_END)) {
-            return consume_error(detail::DOCNO_END, is);
+        if (digits.empty() or digits.size() > 18) {
+            return std::nullopt;
         }
-        std::string url = "";
-        std::ostringstream content;
-        while (not detail::consume(is, detail::DOC_END)) {
-            is >> std::ws;
-            auto tag = detail::consume(is);
-            if (not tag) {
-                return consume_error("any tag ", is);
-            }
-            auto closing_tag = detail::closing_tag(*tag);
-            auto body = detail::read_body(is, closing_tag);
-            if (not body) {
-                return consume_error(closing_tag, is);
-            }
-            if (tag == "URL") {
-                std::copy_if(body->begin(), body->end(), std::back_inserter(url), [](char ch) {
-                    return not std::isspace(ch);
-                });
-            } else if (content_tags.find(*tag) != content_tags.end()) {
-                content << *body;
+        std::size_t number = 0;
+        for (char ch : digits) {
+            if (ch < '0' or ch > '9') {
+                return std::nullopt;
             }
+            number = number * 10 + static_cast<std::size_t>(ch - '0');
         }
-        return Record(std::move(docno), std::move(url), content.str());
+        return number;
     }
 
-    [[nodiscard]] auto read_subsequent_record(std::istream &is) -> Result
-    {
-        return detail::read_subsequent_record(is, read_record);
-    }
+    std::string_view data_{};
+};
 
-}
+class Record;
+class RecordView;
+using Result = std::variant<Record, Error>;
+using ViewResult = std::variant<RecordView, Error>;
 
-namespace web {
+class Record {
+   private:
+    std::string docno_;
+    std::string url_;
+    std::string content_;
 
-    [[nodiscard]] auto parse(std::string_view data) -> Result
+   public:
+    Record() = default;
+    Record(std::string docno, std::string url, std::string content)
+        : docno_(std::move(docno)), url_(std::move(url)), content_(std::move(content))
+    {}
+    /// Replaces all fields, reusing the memory of the current ones.
+    void assign(std::string_view docno, std::string_view url, std::string_view content)
     {
-        std::size_t pos = 0;
-        auto consume_error = [&](auto const &tag) -> Error {
-            auto context_size = std::min(tag.size(), data.size() - pos);
-            auto context = std::string_view(&data[pos], context_size);
-            return Error{"Could not consume " + tag + " in context: " + std::string(context)};
-        };
-        auto read_between = detail::read_between(data, pos);
-
-        auto docno = read_between(detail::DOCNO, detail::DOCNO_END);
-        if (not docno) {
-            return consume_error(detail::DOCNO);
-        }
+        docno_.assign(docno);
+        url_.assign(url);
+        content_.assign(content);
+    }
+    [[nodiscard]] auto content_length() const -> std::size_t { return content_.size(); }
+    [[nodiscard]] auto content() -> std::string && { return std::move(content_); }
+    [[nodiscard]] auto content() const -> std::string const & { return content_; }
+    [[nodiscard]] auto url() const -> std::string const & { return url_; }
+    [[nodiscard]] auto url() -> std::string && { return std::move(url_); }
+    [[nodiscard]] auto trecid() const -> std::string const & { return docno_; }
+    [[nodiscard]] auto trecid() -> std::string && { return std::move(docno_); }
+
+    friend std::ostream &operator<<(std::ostream &os, Record const &record);
+};
+
+std::ostream &operator<<(std::ostream &os, Error const &error);
+
+/// Non-owning counterpart of `Record`.
+/// All fields point into the buffer the record was parsed from,
+/// and are valid only as long as that buffer is.
+/// Unlike `Record`, it also carries the HTTP header of trecweb records.
+class RecordView {
+   private:
+    std::string_view docno_;
+    std::string_view url_;
+    std::string_view content_;
+    std::string_view header_;
+
+   public:
+    RecordView(std::string_view docno,
+               std::string_view url,
+               std::string_view content,
+               std::string_view header = {})
+        : docno_(docno), url_(url), content_(content), header_(header)
+    {}
+    [[nodiscard]] auto content_length() const -> std::size_t { return content_.size(); }
+    [[nodiscard]] auto content() const -> std::string_view { return content_; }
+    [[nodiscard]] auto url() const -> std::string_view { return url_; }
+    [[nodiscard]] auto trecid() const -> std::string_view { return docno_; }
+    /// Returns the HTTP header; empty for trectext records,
+    /// or if `Fields::Header` was not in the projection.
+    [[nodiscard]] auto header() const -> HttpHeader { return HttpHeader(header_); }
+    [[nodiscard]] auto to_record() const -> Record
+    {
+        return Record(std::string(docno_), std::string(url_), std::string(content_));
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, RecordView const &record);
+};
+
+/// A batch of records stored column-wise in a single arena.
+///
+/// The fields of all records are appended to one contiguous buffer,
+/// and each field is located by an array of offsets into it,
+/// so reading a batch costs no allocations once the batch has grown to its working size.
+/// Clearing the batch keeps its memory for the next one.
+class RecordBatch {
+   public:
+    [[nodiscard]] auto size() const -> std::size_t { return docno_offsets_.size(); }
+    [[nodiscard]] auto empty() const -> bool { return docno_offsets_.empty(); }
+    [[nodiscard]] auto trecid(std::size_t idx) const -> std::string_view
+    {
+        return field(docno_offsets_[idx], url_offsets_[idx]);
+    }
+    [[nodiscard]] auto url(std::size_t idx) const -> std::string_view
+    {
+        return field(url_offsets_[idx], content_offsets_[idx]);
+    }
+    [[nodiscard]] auto content(std::size_t idx) const -> std::string_view
+    {
+        auto end = idx + 1 < size() ? docno_offsets_[idx + 1] : arena_.size();
+        return field(content_offsets_[idx], end);
+    }
+    [[nodiscard]] auto operator[](std::size_t idx) const -> RecordView
+    {
+        return RecordView(trecid(idx), url(idx), content(idx));
+    }
+
+    /// Offsets of the fields into `arena()`. The end of a field is the beginning of
+    /// the next one: URL follows docno, content follows URL, and the next docno follows content.
+    [[nodiscard]] auto docno_offsets() const -> std::vector<std::size_t> const &
+    {
+        return docno_offsets_;
+    }
+    [[nodiscard]] auto url_offsets() const -> std::vector<std::size_t> const &
+    {
+        return url_offsets_;
+    }
+    [[nodiscard]] auto content_offsets() const -> std::vector<std::size_t> const &
+    {
+        return content_offsets_;
+    }
+    [[nodiscard]] auto arena() const -> std::string_view { return arena_; }
+
+    /// Errors encountered while reading the batch, other than the end of input.
+    [[nodiscard]] auto errors() const -> std::vector<Error> const & { return errors_; }
+
+    void push_back(std::string_view docno, std::string_view url, std::string_view content)
+    {
+        docno_offsets_.push_back(arena_.size());
+        arena_.append(docno);
+        url_offsets_.push_back(arena_.size());
+        arena_.append(url);
+        content_offsets_.push_back(arena_.size());
+        arena_.append(content);
+    }
+    void push_back(RecordView const &record)
+    {
+        push_back(record.trecid(), record.url(), record.content());
+    }
+    void push_back_error(Error error) { errors_.push_back(std::move(error)); }
+
+    /// Removes all records and errors, keeping the allocated memory.
+    void clear()
+    {
+        arena_.clear();
+        docno_offsets_.clear();
+        url_offsets_.clear();
+        content_offsets_.clear();
+        errors_.clear();
+    }
+
+   private:
+    [[nodiscard]] auto field(std::size_t begin, std::size_t end) const -> std::string_view
+    {
+        return std::string_view(arena_).substr(begin, end - begin);
+    }
+
+    std::string arena_;
+    std::vector<std::size_t> docno_offsets_;
+    std::vector<std::size_t> url_offsets_;
+    std::vector<std::size_t> content_offsets_;
+    std::vector<Error> errors_;
+};
+
+/// Input range of the records read by a parser, for use in range-based `for` loops.
+///
+/// All records are read into a single `Record`, whose strings keep their capacity
+/// from one record to the next, so iterating does not allocate once they have grown
+/// to fit the largest record. A reference obtained from the iterator is only valid
+/// until it is incremented. Records that cannot be parsed are skipped and passed
+/// to `on_error`, if given.
+///
+/// `Parser` (possibly a reference type) must have `eof()` and
+/// `read_record(Record &) -> std::optional<Error>`.
+template <typename Parser>
+class RecordRange {
+   public:
+    class iterator {
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Record;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Record const *;
+        using reference = Record const &;
+
+        iterator() = default;
+        explicit iterator(RecordRange *range) : range_(range) { advance(); }
+
+        [[nodiscard]] auto operator*() const -> reference { return range_->record_; }
+        [[nodiscard]] auto operator->() const -> pointer { return &range_->record_; }
+        auto operator++() -> iterator &
+        {
+            advance();
+            return *this;
+        }
+        auto operator++(int) -> iterator
+        {
+            auto copy = *this;
+            advance();
+            return copy;
+        }
+        [[nodiscard]] friend auto operator==(iterator const &lhs, iterator const &rhs) -> bool
+        {
+            return lhs.range_ == rhs.range_;
+        }
+        [[nodiscard]] friend auto operator!=(iterator const &lhs, iterator const &rhs) -> bool
+        {
+            return lhs.range_ != rhs.range_;
+        }
+
+       private:
+        void advance()
+        {
+            if (not range_->next()) {
+                range_ = nullptr;
+            }
+        }
+
+        RecordRange *range_ = nullptr;
+    };
+
+    template <typename P>
+    explicit RecordRange(P &&parser, std::function<void(Error const &)> on_error = {})
+        : parser_(std::forward<P>(parser)), on_error_(std::move(on_error))
+    {
+    }
+
+    /// Reads the first record; a range can only be iterated once.
+    [[nodiscard]] auto begin() -> iterator { return iterator(this); }
+    [[nodiscard]] auto end() -> iterator { return iterator(); }
+
+   private:
+    /// Reads the next valid record; returns `false` at the end of the input.
+    [[nodiscard]] auto next() -> bool
+    {
+        while (not parser_.eof()) {
+            auto error = parser_.read_record(record_);
+            if (not error) {
+                return true;
+            }
+            if (on_error_) {
+                on_error_(*error);
+            }
+        }
+        return false;
+    }
+
+    Parser parser_;
+    std::function<void(Error const &)> on_error_;
+    Record record_{};
+};
+
+/// Returns the range of the records read by `parser`; see `RecordRange`.
+template <typename Parser>
+[[nodiscard]] auto records(Parser &parser, std::function<void(Error const &)> on_error = {})
+    -> RecordRange<Parser &>
+{
+    return RecordRange<Parser &>(parser, std::move(on_error));
+}
+
+/// Read-only memory mapping of a whole file.
+class MappedFile {
+   public:
+    /// Expected access pattern, passed on to the kernel to tune read-ahead.
+    enum class Access { Sequential, Random };
+
+    explicit MappedFile(std::string const &path, Access access = Access::Sequential)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Unable to open " + path);
+        }
+        struct stat st {};
+        if (::fstat(fd, &st) < 0) {
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "Unable to stat " + path);
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ > 0) {
+            void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                auto err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), "Unable to map " + path);
+            }
+            ::madvise(addr, size_, access == Access::Random ? MADV_RANDOM : MADV_SEQUENTIAL);
+            addr_ = static_cast<char const *>(addr);
+        }
+        ::close(fd);
+    }
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    MappedFile(MappedFile &&other) noexcept
+        : addr_(std::exchange(other.addr_, nullptr)), size_(std::exchange(other.size_, 0))
+    {}
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other) {
+            unmap();
+            addr_ = std::exchange(other.addr_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+    ~MappedFile() { unmap(); }
+
+    [[nodiscard]] auto data() const -> std::string_view { return std::string_view(addr_, size_); }
+    [[nodiscard]] auto size() const -> std::size_t { return size_; }
+
+   private:
+    void unmap()
+    {
+        if (addr_ != nullptr) {
+            ::munmap(const_cast<char *>(addr_), size_);
+            addr_ = nullptr;
+        }
+    }
+
+    char const *addr_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+/// Source reading an `std::istream`, which is not owned.
+///
+/// Sources supply the input of the buffered parsers: a source is any movable type with
+/// a member `read(char *out, std::size_t size)` writing up to `size` bytes to `out`
+/// and returning their number, which is 0 only at the end of the input.
+/// The parsers call it once per chunk of the input.
+class IstreamSource {
+   public:
+    // Not explicit, so that parsers can be constructed from a stream as before.
+    IstreamSource(std::istream &input) : input_(&input) {}
+
+    [[nodiscard]] auto read(char *out, std::size_t size) -> std::size_t
+    {
+        input_->read(out, static_cast<std::streamsize>(size));
+        return static_cast<std::size_t>(input_->gcount());
+    }
+
+    /// Skips the next `size` bytes, seeking if the stream supports it.
+    /// Returns the number of bytes skipped, fewer only at the end of the input.
+    auto skip(std::size_t size) -> std::size_t
+    {
+        auto position = static_cast<std::streamoff>(input_->tellg());
+        if (position >= 0) {
+            auto end = static_cast<std::streamoff>(input_->seekg(0, std::ios::end).tellg());
+            auto target = std::min(end, position + static_cast<std::streamoff>(size));
+            if (end >= 0 and input_->seekg(target)) {
+                return static_cast<std::size_t>(target - position);
+            }
+        }
+        input_->clear();
+        input_->ignore(static_cast<std::streamsize>(size));
+        return static_cast<std::size_t>(input_->gcount());
+    }
+
+   private:
+    std::istream *input_;
+};
+
+/// Source reading a buffer, such as the data of a `MappedFile`, which must outlive it.
+///
+/// Data is copied to the parser buffer; `web::MappedParser` parses a mapping without copying.
+class ViewSource {
+   public:
+    explicit ViewSource(std::string_view data) : data_(data) {}
+
+    [[nodiscard]] auto read(char *out, std::size_t size) -> std::size_t
+    {
+        size = std::min(size, data_.size());
+        std::memcpy(out, data_.data(), size);
+        data_.remove_prefix(size);
+        return size;
+    }
+
+    auto skip(std::size_t size) -> std::size_t
+    {
+        size = std::min(size, data_.size());
+        data_.remove_prefix(size);
+        return size;
+    }
+
+   private:
+    std::string_view data_;
+};
+
+/// Source reading a file descriptor with `read(2)`, bypassing `std::istream`.
+///
+/// Files opened by path are read sequentially, which is advised to the kernel.
+/// With direct I/O, a file is opened with `O_DIRECT` where supported, so that it does not
+/// fill the page cache, and is read in aligned blocks that are then copied out;
+/// it falls back to regular reads if the file system does not support it.
+/// Read errors are reported by throwing `std::system_error`.
+class FdSource {
+   public:
+    /// Reads from `fd`, such as `STDIN_FILENO`, which is not closed.
+    explicit FdSource(int fd) : fd_(fd) {}
+
+    explicit FdSource(std::string const &path, bool direct = false) : owned_(true)
+    {
+#ifdef O_DIRECT
+        if (direct) {
+            fd_ = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+            direct = fd_ >= 0;
+        }
+#else
+        direct = false;
+#endif
+        if (fd_ < 0) {
+            fd_ = ::open(path.c_str(), O_RDONLY);
+        }
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "Unable to open " + path);
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        if (direct) {
+            void *block = nullptr;
+            if (::posix_memalign(&block, DIRECT_ALIGNMENT, DIRECT_BLOCK_SIZE) != 0) {
+                throw std::bad_alloc();
+            }
+            block_.reset(static_cast<char *>(block));
+        }
+    }
+    FdSource(FdSource const &) = delete;
+    FdSource &operator=(FdSource const &) = delete;
+    FdSource(FdSource &&other) noexcept
+        : fd_(std::exchange(other.fd_, -1)),
+          owned_(std::exchange(other.owned_, false)),
+          block_(std::move(other.block_)),
+          block_begin_(other.block_begin_),
+          block_end_(other.block_end_),
+          peeked_(std::move(other.peeked_))
+    {}
+    FdSource &operator=(FdSource &&other) noexcept
+    {
+        if (this != &other) {
+            close();
+            fd_ = std::exchange(other.fd_, -1);
+            owned_ = std::exchange(other.owned_, false);
+            block_ = std::move(other.block_);
+            block_begin_ = other.block_begin_;
+            block_end_ = other.block_end_;
+            peeked_ = std::move(other.peeked_);
+        }
+        return *this;
+    }
+    ~FdSource() { close(); }
+
+    [[nodiscard]] auto read(char *out, std::size_t size) -> std::size_t
+    {
+        if (not peeked_.empty()) {
+            size = std::min(size, peeked_.size());
+            std::memcpy(out, peeked_.data(), size);
+            peeked_.erase(0, size);
+            return size;
+        }
+        return read_unpeeked(out, size);
+    }
+
+    /// Returns up to the first `size` bytes left to read, without consuming them,
+    /// such as to detect compression.
+    [[nodiscard]] auto peek(std::size_t size) -> std::string_view
+    {
+        while (peeked_.size() < size) {
+            auto offset = peeked_.size();
+            peeked_.resize(size);
+            peeked_.resize(offset + read_unpeeked(peeked_.data() + offset, size - offset));
+            if (peeked_.size() == offset) {
+                break;
+            }
+        }
+        return peeked_;
+    }
+
+    /// Skips the next `size` bytes, seeking if the file descriptor supports it,
+    /// and otherwise (for pipes) reading them.
+    /// Returns the number of bytes skipped, fewer only at the end of the input.
+    auto skip(std::size_t size) -> std::size_t
+    {
+        auto skipped = std::min(size, peeked_.size());
+        peeked_.erase(0, skipped);
+        auto position = ::lseek(fd_, 0, SEEK_CUR);
+        auto end = position < 0 ? position : ::lseek(fd_, 0, SEEK_END);
+        if (end >= 0) {
+            // Direct I/O must continue from an aligned offset, from which the rest is read.
+            position -= static_cast<off_t>(block_end_ - block_begin_);
+            auto target = std::min(end, position + static_cast<off_t>(size - skipped));
+            auto aligned
+                = block_ ? target - target % static_cast<off_t>(DIRECT_ALIGNMENT) : target;
+            if (::lseek(fd_, aligned, SEEK_SET) < 0) {
+                throw std::system_error(errno, std::generic_category(), "Unable to seek input");
+            }
+            block_begin_ = 0;
+            block_end_ = 0;
+            if (aligned < target) {
+                block_end_ = read_fd(block_.get(), DIRECT_BLOCK_SIZE);
+                block_begin_ = std::min(static_cast<std::size_t>(target - aligned), block_end_);
+            }
+            return skipped + static_cast<std::size_t>(target - position);
+        }
+        std::unique_ptr<char[]> discarded(new char[DIRECT_BLOCK_SIZE]);
+        while (skipped < size) {
+            auto count
+                = read_unpeeked(discarded.get(), std::min(size - skipped, DIRECT_BLOCK_SIZE));
+            if (count == 0) {
+                break;
+            }
+            skipped += count;
+        }
+        return skipped;
+    }
+
+   private:
+    static constexpr std::size_t DIRECT_ALIGNMENT = 4096;
+    static constexpr std::size_t DIRECT_BLOCK_SIZE = std::size_t{1} << 20;
+
+    struct Free {
+        void operator()(char *ptr) const { std::free(ptr); }
+    };
+
+    [[nodiscard]] auto read_unpeeked(char *out, std::size_t size) -> std::size_t
+    {
+        if (not block_) {
+            return read_fd(out, size);
+        }
+        if (block_begin_ == block_end_) {
+            block_begin_ = 0;
+            block_end_ = read_fd(block_.get(), DIRECT_BLOCK_SIZE);
+        }
+        size = std::min(size, block_end_ - block_begin_);
+        std::memcpy(out, block_.get() + block_begin_, size);
+        block_begin_ += size;
+        return size;
+    }
+
+    [[nodiscard]] auto read_fd(char *out, std::size_t size) -> std::size_t
+    {
+        while (true) {
+            auto count = ::read(fd_, out, size);
+            if (count >= 0) {
+                return static_cast<std::size_t>(count);
+            }
+#ifdef O_DIRECT
+            if (errno == EINVAL and block_) {
+                // Direct I/O is not supported here after all.
+                ::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) & ~O_DIRECT);
+                continue;
+            }
+#endif
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "Unable to read input");
+            }
+        }
+    }
+
+    void close()
+    {
+        if (owned_ and fd_ >= 0) {
+            ::close(fd_);
+        }
+        fd_ = -1;
+    }
+
+    int fd_ = -1;
+    bool owned_ = false;
+    std::unique_ptr<char, Free> block_{};
+    std::size_t block_begin_ = 0;
+    std::size_t block_end_ = 0;
+    std::string peeked_{};
+};
+
+namespace web {
+
+    /// How the parsers find the end of a trecweb record.
+    enum class Framing {
+        /// At the first `</DOC>` tag, scanning the whole body for it.
+        Scan,
+        /// At `Content-Length` bytes past the HTTP header, where `</DOC>` is only verified.
+        ///
+        /// This skips the scan of the body, and trusts the length: a body containing
+        /// `</DOC>` is kept whole rather than cut short. Records without a valid length,
+        /// or without `</DOC>` at the expected position, fall back to `Scan`.
+        ContentLength,
+    };
+
+} // namespace web
+
+namespace detail {
+
+    static std::string const DOC = "<DOC>";
+    static std::string const DOC_END = "</DOC>";
+    static std::string const DOCNO = "<DOCNO>";
+    static std::string const DOCNO_END = "</DOCNO>";
+    static std::string const DOCHDR = "<DOCHDR>";
+    static std::string const DOCHDR_END = "</DOCHDR>";
+    static std::string const URL = "<URL>";
+    static std::string const URL_END = "</URL>";
+
+    /// Whitespace as classified by `std::isspace` in the "C" locale.
+    [[nodiscard]] constexpr auto is_space(unsigned char ch) -> bool
+    {
+        return ch == ' ' || static_cast<unsigned char>(ch - '\t') <= '\r' - '\t';
+    }
+
+    /// Delimiter scanning primitives.
+    ///
+    /// `find` looks for a tag by first finding candidate positions where both the first (`<`)
+    /// and the last character of the tag match, and only then compares the full tag.
+    /// `find_ws` and `find_non_ws` look for the first (non-)whitespace character.
+    /// All of them return the size of the data if nothing is found.
+    /// Vectorized implementations are selected at runtime based on the CPU features.
+    namespace scan {
+
+        using find_fn = std::size_t (*)(char const *, std::size_t, char const *, std::size_t);
+        using find_ws_fn = std::size_t (*)(char const *, std::size_t);
+        using find_special_fn = std::size_t (*)(char const *, std::size_t, char, char);
+
+        struct Scanner {
+            find_fn find;
+            find_ws_fn find_ws;
+            find_ws_fn find_non_ws;
+            /// Finds the first control character (below 0x20), or `a`, or `b`.
+            find_special_fn find_special;
+            /// Finds the first `a` or `b`.
+            find_special_fn find_either;
+        };
+
+        namespace generic {
+
+            [[nodiscard]] auto find(char const *data,
+                                           std::size_t size,
+                                           char const *tag,
+                                           std::size_t tag_size) -> std::size_t
+            {
+                if (tag_size == 0) {
+                    return 0;
+                }
+                auto const *pos = data;
+                auto const *last = data + size;
+                while (static_cast<std::size_t>(last - pos) >= tag_size) {
+                    pos = static_cast<char const *>(
+                        std::memchr(pos, tag[0], (last - pos) - tag_size + 1));
+                    if (pos == nullptr) {
+                        break;
+                    }
+                    if (std::memcmp(pos + 1, tag + 1, tag_size - 1) == 0) {
+                        return pos - data;
+                    }
+                    ++pos;
+                }
+                return size;
+            }
+
+            [[nodiscard]] auto find_ws(char const *data, std::size_t size) -> std::size_t
+            {
+                return std::find_if(data, data + size, is_space) - data;
+            }
+
+            [[nodiscard]] auto find_non_ws(char const *data, std::size_t size)
+                -> std::size_t
+            {
+                return std::find_if_not(data, data + size, is_space) - data;
+            }
+
+            [[nodiscard]] auto find_special(char const *data, std::size_t size, char a, char b)
+                -> std::size_t
+            {
+                return std::find_if(data,
+                                    data + size,
+                                    [a, b](char ch) {
+                                        return static_cast<unsigned char>(ch) < 0x20U or ch == a
+                                               or ch == b;
+                                    })
+                       - data;
+            }
+
+            [[nodiscard]] auto find_either(char const *data, std::size_t size, char a, char b)
+                -> std::size_t
+            {
+                return std::find_if(
+                           data, data + size, [a, b](char ch) { return ch == a or ch == b; })
+                       - data;
+            }
+
+        } // namespace generic
+
+#if defined(__x86_64__) || defined(__i386__)
+
+        namespace sse {
+
+            __attribute__((target("sse4.2"))) auto
+            find(char const *data, std::size_t size, char const *tag, std::size_t tag_size)
+                -> std::size_t
+            {
+                if (tag_size < 2) {
+                    return generic::find(data, size, tag, tag_size);
+                }
+                auto first = _mm_set1_epi8(tag[0]);
+                auto last = _mm_set1_epi8(tag[tag_size - 1]);
+                std::size_t pos = 0;
+                for (; pos + tag_size - 1 + 16 <= size; pos += 16) {
+                    auto block_first =
+                        _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + pos));
+                    auto block_last = _mm_loadu_si128(
+                        reinterpret_cast<__m128i const *>(data + pos + tag_size - 1));
+                    unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+                        _mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+                    while (mask != 0) {
+                        auto offset = pos + __builtin_ctz(mask);
+                        if (std::memcmp(data + offset + 1, tag + 1, tag_size - 2) == 0) {
+                            return offset;
+                        }
+                        mask &= mask - 1;
+                    }
+                }
+                return pos + generic::find(data + pos, size - pos, tag, tag_size);
+            }
+
+            /// Bit mask of whitespace characters in a block.
+            __attribute__((target("sse4.2"))) auto ws_mask(__m128i block) -> unsigned
+            {
+                auto shifted = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+                auto control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')),
+                                              shifted);
+                auto space = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+                return _mm_movemask_epi8(_mm_or_si128(control, space));
+            }
+
+            __attribute__((target("sse4.2"))) auto find_ws(char const *data,
+                                                                   std::size_t size)
+                -> std::size_t
+            {
+                std::size_t pos = 0;
+                for (; pos + 16 <= size; pos += 16) {
+                    auto block = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + pos));
+                    if (auto mask = ws_mask(block); mask != 0) {
+                        return pos + __builtin_ctz(mask);
+                    }
+                }
+                return pos + generic::find_ws(data + pos, size - pos);
+            }
+
+            __attribute__((target("sse4.2"))) auto find_non_ws(char const *data,
+                                                                       std::size_t size)
+                -> std::size_t
+            {
+                std::size_t pos = 0;
+                for (; pos + 16 <= size; pos += 16) {
+                    auto block = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + pos));
+                    if (auto mask = ~ws_mask(block) & 0xFFFFu; mask != 0) {
+                        return pos + __builtin_ctz(mask);
+                    }
+                }
+                return pos + generic::find_non_ws(data + pos, size - pos);
+            }
+
+            __attribute__((target("sse4.2"))) auto
+            find_special(char const *data, std::size_t size, char a, char b) -> std::size_t
+            {
+                auto max_control = _mm_set1_epi8(0x1F);
+                auto first = _mm_set1_epi8(a);
+                auto second = _mm_set1_epi8(b);
+                std::size_t pos = 0;
+                for (; pos + 16 <= size; pos += 16) {
+                    auto block = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + pos));
+                    auto control = _mm_cmpeq_epi8(_mm_min_epu8(block, max_control), block);
+                    auto special = _mm_or_si128(
+                        control,
+                        _mm_or_si128(_mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block, second)));
+                    if (auto mask = _mm_movemask_epi8(special); mask != 0) {
+                        return pos + __builtin_ctz(mask);
+                    }
+                }
+                return pos + generic::find_special(data + pos, size - pos, a, b);
+            }
+
+            __attribute__((target("sse4.2"))) auto
+            find_either(char const *data, std::size_t size, char a, char b) -> std::size_t
+            {
+                auto first = _mm_set1_epi8(a);
+                auto second = _mm_set1_epi8(b);
+                std::size_t pos = 0;
+                for (; pos + 16 <= size; pos += 16) {
+                    auto block = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + pos));
+                    auto either =
+                        _mm_or_si128(_mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block, second));
+                    if (auto mask = _mm_movemask_epi8(either); mask != 0) {
+                        return pos + __builtin_ctz(mask);
+                    }
+                }
+                return pos + generic::find_either(data + pos, size - pos, a, b);
+            }
+
+        } // namespace sse
+
+        namespace avx2 {
+
+            __attribute__((target("avx2"))) auto
+            find(char const *data, std::size_t size, char const *tag, std::size_t tag_size)
+                -> std::size_t
+            {
+                if (tag_size < 2) {
+                    return generic::find(data, size, tag, tag_size);
+                }
+                auto first = _mm256_set1_epi8(tag[0]);
+                auto last = _mm256_set1_epi8(tag[tag_size - 1]);
+                std::size_t pos = 0;
+                for (; pos + tag_size - 1 + 32 <= size; pos += 32) {
+                    auto block_first =
+                        _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + pos));
+                    auto block_last = _mm256_loadu_si256(
+                        reinterpret_cast<__m256i const *>(data + pos + tag_size - 1));
+                    unsigned mask = _mm256_movemask_epi8(
+                        _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                         _mm256_cmpeq_epi8(block_last, last)));
+                    while (mask != 0) {
+                        auto offset = pos + __builtin_ctz(mask);
+                        if (std::memcmp(data + offset + 1, tag + 1, tag_size - 2) == 0) {
+                            return offset;
+                        }
+                        mask &= mask - 1;
+                    }
+                }
+                return pos + sse::find(data + pos, size - pos, tag, tag_size);
+            }
+
+            /// Bit mask of whitespace characters in a block.
+            __attribute__((target("avx2"))) auto ws_mask(__m256i block) -> unsigned
+            {
+                auto shifted = _mm256_sub_epi8(block, _mm256_set1_epi8('\t'));
+                auto control = _mm256_cmpeq_epi8(
+                    _mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+                auto space = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+                return _mm256_movemask_epi8(_mm256_or_si256(control, space));
+            }
+
+            __attribute__((target("avx2"))) auto find_ws(char const *data,
+                                                                 std::size_t size)
+                -> std::size_t
+            {
+                std::size_t pos = 0;
+                for (; pos + 32 <= size; pos += 32) {
+                    auto block =
+                        _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + pos));
+                    if (auto mask = ws_mask(block); mask != 0) {
+                        return pos + __builtin_ctz(mask);
+                    }
+                }
+                return pos + sse::find_ws(data + pos, size - pos);
+            }
+
+            __attribute__((target("avx2"))) auto find_non_ws(char const *data,
+                                                                     std::size_t size)
+                -> std::size_t
+            {
+                std::size_t pos = 0;
+                for (; pos + 32 <= size; pos += 32) {
+                    auto block =
+                        _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + pos));
+                    if (auto mask = ~ws_mask(block); mask != 0) {
+                        return pos + __builtin_ctz(mask);
+                    }
+                }
+                return pos + sse::find_non_ws(data + pos, size - pos);
+            }
+
+            __attribute__((target("avx2"))) auto
+            find_special(char const *data, std::size_t size, char a, char b) -> std::size_t
+            {
+                auto max_control = _mm256_set1_epi8(0x1F);
+                auto first = _mm256_set1_epi8(a);
+                auto second = _mm256_set1_epi8(b);
+                std::size_t pos = 0;
+                for (; pos + 32 <= size; pos += 32) {
+                    auto block =
+                        _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + pos));
+                    auto control = _mm256_cmpeq_epi8(_mm256_min_epu8(block, max_control), block);
+                    auto special = _mm256_or_si256(control,
+                                                   _mm256_or_si256(_mm256_cmpeq_epi8(block, first),
+                                                                   _mm256_cmpeq_epi8(block, second)));
+                    if (unsigned mask = _mm256_movemask_epi8(special); mask != 0) {
+                        return pos + __builtin_ctz(mask);
+                    }
+                }
+                return pos + sse::find_special(data + pos, size - pos, a, b);
+            }
+
+            __attribute__((target("avx2"))) auto
+            find_either(char const *data, std::size_t size, char a, char b) -> std::size_t
+            {
+                auto first = _mm256_set1_epi8(a);
+                auto second = _mm256_set1_epi8(b);
+                std::size_t pos = 0;
+                for (; pos + 32 <= size; pos += 32) {
+                    auto block =
+                        _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + pos));
+                    auto either = _mm256_or_si256(_mm256_cmpeq_epi8(block, first),
+                                                  _mm256_cmpeq_epi8(block, second));
+                    if (unsigned mask = _mm256_movemask_epi8(either); mask != 0) {
+                        return pos + __builtin_ctz(mask);
+                    }
+                }
+                return pos + sse::find_either(data + pos, size - pos, a, b);
+            }
+
+        } // namespace avx2
+
+#endif
+
+        [[nodiscard]] auto select_scanner() -> Scanner
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return {avx2::find,
+                        avx2::find_ws,
+                        avx2::find_non_ws,
+                        avx2::find_special,
+                        avx2::find_either};
+            }
+            if (__builtin_cpu_supports("sse4.2")) {
+                return {sse::find,
+                        sse::find_ws,
+                        sse::find_non_ws,
+                        sse::find_special,
+                        sse::find_either};
+            }
+#endif
+            return {generic::find,
+                    generic::find_ws,
+                    generic::find_non_ws,
+                    generic::find_special,
+                    generic::find_either};
+        }
+
+        [[nodiscard]] auto scanner() -> Scanner const &
+        {
+            static Scanner const instance = select_scanner();
+            return instance;
+        }
+
+    } // namespace scan
+
+    /// Finds `tag` in `data` starting at `pos`; returns `std::string_view::npos` if not found.
+    [[nodiscard]] auto find_tag(std::string_view data, std::string_view tag, std::size_t pos)
+        -> std::size_t
+    {
+        if (pos >= data.size()) {
+            return std::string_view::npos;
+        }
+        pos += scan::scanner().find(data.data() + pos, data.size() - pos, tag.data(), tag.size());
+        return pos == data.size() ? std::string_view::npos : pos;
+    }
+
+    [[nodiscard]] auto skip_ws(std::string_view const &data, std::size_t pos) -> std::size_t
+    {
+        if (pos >= data.size()) {
+            return data.size();
+        }
+        return pos + scan::scanner().find_non_ws(data.data() + pos, data.size() - pos);
+    }
+
+    [[nodiscard]] auto skip_to_ws(std::string_view const &data, std::size_t pos) -> std::size_t
+    {
+        if (pos >= data.size()) {
+            return data.size();
+        }
+        return pos + scan::scanner().find_ws(data.data() + pos, data.size() - pos);
+    }
+
+    [[nodiscard]] auto read_between(std::string_view const &data, std::size_t &pos)
+    {
+        return [&](auto const &open, auto const &close) -> std::optional<std::string_view> {
+            auto begin = find_tag(data, open, pos);
+            if (begin == std::string_view::npos) {
+                return std::nullopt;
+            } else {
+                begin += open.size();
+            }
+            auto end = find_tag(data, close, begin);
+            if (end == std::string_view::npos) {
+                return std::nullopt;
+            }
+            pos = end;
+            return std::string_view(&data[begin], end - begin);
+        };
+    }
+
+    [[nodiscard]] auto consumer(std::string_view &data, std::size_t &pos)
+    {
+        return [&](auto const &tag) {
+            pos = skip_ws(data, pos);
+            auto tag_len = tag.size();
+            if (pos + tag_len < pos && data.substr(pos, tag_len) == tag) {
+                pos += tag_len;
+                return true;
+            } else {
+                return false;
+            }
+        };
+    }
+
+    bool consume(std::istream &is, std::string const &token)
+    {
+        is >> std::ws;
+        for (auto pos = token.begin(); pos != token.end(); ++pos) {
+            if (is.get() != *pos) {
+                is.unget();
+                for (auto rpos = std::reverse_iterator(pos); rpos != token.rend(); ++rpos) {
+                    is.putback(*rpos);
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Pred>
+    std::ostream& read_until(std::istream &is, Pred pred, std::ostream& os)
+    {
+        while (not is.eof()) {
+            if (is.peek() == std::istream::traits_type::eof() or pred(is.peek())) {
+                break;
+            }
+            os.put(is.get());
+        }
+        return os;
+    }
+
+    template <typename Pred>
+    std::string read_until(std::istream &is, Pred pred)
+    {
+        std::ostringstream os;
+        read_until(is, pred, os);
+        return os.str();
+    }
+
+    std::optional<std::string> consume(std::istream &is)
+    {
+        is >> std::ws;
+        if (is.peek() == std::istream::traits_type::eof() or is.peek() != '<') {
+            return std::nullopt;
+        }
+        is.ignore(1);
+        auto tag = read_until(is, [](char ch) { return ch == '>'; });
+        if (is.peek() == '>') {
+            is.ignore(1);
+            auto first_whitespace = std::find_if(
+                tag.begin(), tag.end(), [](unsigned char ch) { return std::isspace(ch); });
+            auto size = std::distance(tag.begin(), first_whitespace);
+            tag.resize(size);
+            return std::make_optional(tag);
+        }
+        return std::nullopt;
+    }
+
+    std::optional<std::string> read_body(std::istream &is, std::string const &closing_tag)
+    {
+        std::ostringstream os;
+        while (read_until(is, [](auto ch) { return ch == '<'; }, os)) {
+            if (is.peek() == std::istream::traits_type::eof()) {
+                break;
+            }
+            if (consume(is, closing_tag)) {
+                return std::make_optional(os.str());
+            }
+            os.put(is.get());
+        }
+        return std::nullopt;
+    }
+
+    std::string_view read_token(std::string_view const &data, std::size_t &pos)
+    {
+        pos = skip_ws(data, pos);
+        auto first = pos;
+        pos = skip_to_ws(data, pos + 1);
+        return std::string_view(&data[first], pos - first);
+    }
+
+    std::string read_token(std::istream &is)
+    {
+        return read_until(is, [](char c) { return c == '<' || std::isspace(c); });
+    }
+
+    /// Maximum length of the context of an error, so that reporting an error
+    /// in a long line, such as in minified HTML, does not cost more than the line itself.
+    constexpr std::size_t ERROR_CONTEXT_SIZE = 256;
+
+    /// Returns the context of an error at `pos`: the rest of the line,
+    /// up to `ERROR_CONTEXT_SIZE` bytes.
+    [[nodiscard]] auto error_context(std::string_view data, std::size_t pos) -> std::string_view
+    {
+        auto context = data.substr(std::min(pos, data.size()), ERROR_CONTEXT_SIZE);
+        return context.substr(0, context.find('\n'));
+    }
+
+    /// Returns the context of an error concerning the whole record beginning at `pos`:
+    /// the line with its `<DOCNO>` if there is one, so that the record can be identified.
+    [[nodiscard]] auto record_context(std::string_view data, std::size_t pos)
+        -> std::string_view
+    {
+        auto docno = find_tag(data, DOCNO, pos);
+        return error_context(data, docno == std::string_view::npos ? pos : docno);
+    }
+
+    /// Skips to the next `<DOC>` tag, leaving it to be read, and returns `false` if there is none.
+    ///
+    /// The input is skipped in bulk up to each `<`, and the characters following it are only
+    /// peeked at, so nothing but the tag itself is put back.
+    [[nodiscard]] auto skip_to_doc(std::istream &is) -> bool
+    {
+        auto const tag = std::string_view(DOC).substr(1);
+        while (is.ignore(std::numeric_limits<std::streamsize>::max(), '<') and not is.eof()) {
+            std::size_t matched = 0;
+            while (matched < tag.size() and is.peek() == tag[matched]) {
+                is.ignore(1);
+                ++matched;
+            }
+            if (matched == tag.size()) {
+                for (auto pos = DOC.rbegin(); pos != DOC.rend(); ++pos) {
+                    is.putback(*pos);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <class ReadRecord>
+    [[nodiscard]] auto read_subsequent_record(std::istream &is, ReadRecord read_record) -> Result
+    {
+        if (not skip_to_doc(is)) {
+            return Error{"EOF"};
+        }
+        return read_record(is);
+    }
+
+    /// Returns the position where the body of the trecweb record beginning at `pos` ends
+    /// according to its `Content-Length`, or `std::nullopt` if it cannot be determined.
+    /// The body starts after `</DOCHDR>` and one line break.
+    /// It only looks as far as `</DOCHDR>`, which `header_end` is set to if found,
+    /// so that this can be called again once more data is available.
+    [[nodiscard]] auto content_end(std::string_view data, std::size_t pos, std::size_t &header_end)
+        -> std::optional<std::size_t>
+    {
+        header_end = find_tag(data, DOCHDR_END, pos);
+        if (header_end == std::string_view::npos) {
+            return std::nullopt;
+        }
+        auto header = data.substr(pos, header_end - pos);
+        // A header ending past `</DOC>` belongs to a later record.
+        if (find_tag(header, DOC_END, 0) != std::string_view::npos) {
+            return std::nullopt;
+        }
+        auto length = HttpHeader(header).content_length();
+        auto body = header_end + DOCHDR_END.size();
+        if (data.substr(body, 2) == "\r\n") {
+            body += 2;
+        } else if (data.substr(body, 1) == "\n") {
+            body += 1;
+        }
+        if (not length or *length > std::numeric_limits<std::size_t>::max() - body) {
+            return std::nullopt;
+        }
+        return body + *length;
+    }
+
+    /// Returns the position right after `</DOC>` if it follows `pos` after optional whitespace,
+    /// or `std::string_view::npos` if it does not.
+    [[nodiscard]] auto verify_record_end(std::string_view data, std::size_t pos) -> std::size_t
+    {
+        pos = skip_ws(data, pos);
+        if (data.substr(pos, DOC_END.size()) != DOC_END) {
+            return std::string_view::npos;
+        }
+        return pos + DOC_END.size();
+    }
+
+    /// Returns the next chunk of `data` ending with `</DOC>`, starting at `pos`,
+    /// and moves `pos` past it; `std::nullopt` if there is no such chunk.
+    /// See `web::Framing` for how the end of the chunk is found.
+    [[nodiscard]] auto next_record(std::string_view data,
+                                   std::size_t &pos,
+                                   web::Framing framing = web::Framing::Scan)
+        -> std::optional<std::string_view>
+    {
+        auto end = std::string_view::npos;
+        if (framing == web::Framing::ContentLength) {
+            std::size_t header_end = 0;
+            if (auto body_end = content_end(data, pos, header_end); body_end) {
+                end = verify_record_end(data, *body_end);
+            }
+        }
+        if (end == std::string_view::npos) {
+            end = find_tag(data, DOC_END, pos);
+            if (end == std::string_view::npos) {
+                return std::nullopt;
+            }
+            end += DOC_END.size();
+        }
+        auto chunk = data.substr(pos, end - pos);
+        pos = end;
+        return chunk;
+    }
+
+    /// Splits `data` into consecutive ranges of roughly `range_size` bytes.
+    /// Each range except the last one ends right after a `</DOC>` tag,
+    /// which is exactly where the sequential parsers end a record,
+    /// so parsing the ranges independently yields the same records in the same order.
+    [[nodiscard]] auto split_records(std::string_view data, std::size_t range_size)
+        -> std::vector<std::string_view>
+    {
+        std::vector<std::string_view> ranges;
+        std::size_t begin = 0;
+        while (begin < data.size()) {
+            auto end = begin + std::max(range_size, DOC_END.size());
+            if (end >= data.size()) {
+                end = data.size();
+            } else if (end = find_tag(data, DOC_END, end - DOC_END.size()); end == data.npos) {
+                end = data.size();
+            } else {
+                end += DOC_END.size();
+            }
+            ranges.push_back(data.substr(begin, end - begin));
+            begin = end;
+        }
+        return ranges;
+    }
+
+    /// Smallest power of two not less than `size` and the minimal chunk size of 64 KiB.
+    [[nodiscard]] constexpr auto chunk_size(std::size_t size) -> std::size_t
+    {
+        std::size_t chunk = std::size_t{1} << 16;
+        while (chunk < size) {
+            chunk <<= 1;
+        }
+        return chunk;
+    }
+
+    /// Reads ahead on a worker thread.
+    ///
+    /// The worker fills blocks of `block_size` bytes by calling `read(out, size)`,
+    /// which returns the number of bytes read, or 0 at the end of the input,
+    /// and hands them over through a queue of at most `depth` blocks.
+    /// Exceptions thrown by `read` are rethrown by `next`.
+    class Prefetcher {
+       public:
+        Prefetcher(std::function<std::size_t(char *, std::size_t)> read,
+                   std::size_t block_size,
+                   std::size_t depth = 4)
+            : read_(std::move(read)), block_size_(block_size)
+        {
+            for (std::size_t idx = 0; idx < std::max(depth, std::size_t{1}); ++idx) {
+                free_.push_back(std::make_unique<char[]>(block_size_));
+            }
+            worker_ = std::thread([this] { run(); });
+        }
+        Prefetcher(Prefetcher const &) = delete;
+        Prefetcher &operator=(Prefetcher const &) = delete;
+        Prefetcher(Prefetcher &&) = delete;
+        Prefetcher &operator=(Prefetcher &&) = delete;
+        ~Prefetcher()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopped_ = true;
+            }
+            cv_.notify_all();
+            worker_.join();
+        }
+
+        /// Releases the current block, and waits for the next one.
+        /// Returns its size, or 0 at the end of the input.
+        [[nodiscard]] auto next() -> std::size_t
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (current_) {
+                free_.push_back(std::move(current_));
+                cv_.notify_all();
+            }
+            cv_.wait(lock, [this] { return not filled_.empty() || finished_; });
+            if (filled_.empty()) {
+                if (error_) {
+                    std::rethrow_exception(error_);
+                }
+                return 0;
+            }
+            std::tie(current_, size_) = std::move(filled_.front());
+            filled_.pop_front();
+            return size_;
+        }
+
+        /// Returns the block returned by the last call to `next`.
+        [[nodiscard]] auto data() const -> char * { return current_.get(); }
+
+       private:
+        void run()
+        {
+            try {
+                while (true) {
+                    std::unique_ptr<char[]> block;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        cv_.wait(lock, [this] { return not free_.empty() || stopped_; });
+                        if (stopped_) {
+                            break;
+                        }
+                        block = std::move(free_.front());
+                        free_.pop_front();
+                    }
+                    auto size = read_(block.get(), block_size_);
+                    if (size == 0) {
+                        break;
+                    }
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    filled_.emplace_back(std::move(block), size);
+                    cv_.notify_all();
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                error_ = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_ = true;
+            cv_.notify_all();
+        }
+
+        std::function<std::size_t(char *, std::size_t)> read_;
+        std::size_t block_size_;
+        std::unique_ptr<char[]> current_{};
+        std::size_t size_ = 0;
+        std::thread worker_{};
+        std::mutex mutex_{};
+        std::condition_variable cv_{};
+        std::deque<std::unique_ptr<char[]>> free_{};
+        std::deque<std::pair<std::unique_ptr<char[]>, std::size_t>> filled_{};
+        bool stopped_ = false;
+        bool finished_ = false;
+        std::exception_ptr error_{};
+    };
+
+    /// Switches `stats`, if any, to `phase` until destroyed.
+    class PhaseGuard {
+       public:
+        PhaseGuard(ParseStats *stats, ParseStats::Phase phase)
+            : stats_(stats), previous_(stats != nullptr ? stats->enter(phase) : phase)
+        {
+        }
+        PhaseGuard(PhaseGuard const &) = delete;
+        PhaseGuard &operator=(PhaseGuard const &) = delete;
+        PhaseGuard(PhaseGuard &&) = delete;
+        PhaseGuard &operator=(PhaseGuard &&) = delete;
+        ~PhaseGuard()
+        {
+            if (stats_ != nullptr) {
+                stats_->enter(previous_);
+            }
+        }
+
+       private:
+        ParseStats *stats_;
+        ParseStats::Phase previous_;
+    };
+
+    /// Whether `Source` can skip input without reading it, with `skip(std::size_t)`.
+    template <typename Source, typename = void>
+    struct has_skip : std::false_type {};
+    template <typename Source>
+    struct has_skip<Source, std::void_t<decltype(std::declval<Source &>().skip(std::size_t{}))>>
+        : std::true_type {};
+
+    /// Sliding window over an input stream.
+    ///
+    /// Unread data is kept in a single buffer, which is only compacted or grown
+    /// when there is not enough room at its end to read another chunk.
+    template <typename Source>
+    class ReadBuffer {
+       public:
+        /// The input is read in chunks of at least `batch_size` bytes,
+        /// rounded up to a power of two.
+        ReadBuffer(Source source, std::size_t batch_size)
+            : source_(std::move(source)), chunk_size_(chunk_size(batch_size))
+        {
+        }
+
+        /// Returns the buffered data that has not been consumed yet.
+        [[nodiscard]] auto data() const -> std::string_view
+        {
+            return std::string_view(buf_.get() + begin_, end_ - begin_);
+        }
+
+        /// Marks the first `count` bytes of `data()` as consumed.
+        void consume(std::size_t count) { begin_ += count; }
+
+        /// Returns the position of `data()` in the input.
+        [[nodiscard]] auto offset() const -> std::size_t { return read_ - (end_ - begin_); }
+
+        /// Returns `true` if the end of the input has been reached.
+        [[nodiscard]] auto exhausted() const -> bool { return exhausted_; }
+
+        /// Consumes the next `count` bytes of the input, skipping those not buffered yet
+        /// with `Source::skip` if there is one, or else reading them.
+        /// Returns the number of bytes consumed, fewer only at the end of the input.
+        auto skip(std::size_t count) -> std::size_t
+        {
+            auto skipped = std::min(count, data().size());
+            consume(skipped);
+            if (skipped == count) {
+                return skipped;
+            }
+            if constexpr (has_skip<Source>::value) {
+                auto size = source_.skip(count - skipped);
+                read_ += size;
+                skipped += size;
+            } else {
+                while (skipped < count and fill()) {
+                    auto size = std::min(count - skipped, data().size());
+                    consume(size);
+                    skipped += size;
+                }
+            }
+            return skipped;
+        }
+
+        /// Collects I/O and scanning statistics into `stats`, unless it is null.
+        void set_stats(ParseStats *stats) { stats_ = stats; }
+
+        /// Stops reading more once `limit` bytes (at least 64) are buffered and not consumed,
+        /// so that the buffer never grows much beyond `limit` plus one chunk.
+        void set_limit(std::size_t limit) { limit_ = std::max(limit, std::size_t{64}); }
+
+        /// Returns the limit set by `set_limit`, or the maximum size if there is none.
+        [[nodiscard]] auto limit() const -> std::size_t { return limit_; }
+
+        /// Returns `true` if no more can be read until some data is consumed; see `set_limit`.
+        [[nodiscard]] auto full() const -> bool { return end_ - begin_ >= limit_; }
+
+        /// Appends the next chunk of the input to the buffer.
+        /// Returns `false` if no more data could be read, or if the buffer is `full()`.
+        [[nodiscard]] auto fill() -> bool
+        {
+            if (full()) {
+                return false;
+            }
+            PhaseGuard guard(stats_, ParseStats::Phase::Io);
+            if (capacity_ - end_ < chunk_size_) {
+                auto unread = end_ - begin_;
+                if (capacity_ - unread >= chunk_size_) {
+                    std::memmove(buf_.get(), buf_.get() + begin_, unread);
+                } else {
+                    auto capacity = chunk_size(unread + chunk_size_);
+                    if (stats_ != nullptr and capacity_ > 0) {
+                        ++stats_->buffer_growths;
+                    }
+                    std::unique_ptr<char[]> buf(new char[capacity]);
+                    std::memcpy(buf.get(), buf_.get() + begin_, unread);
+                    buf_ = std::move(buf);
+                    capacity_ = capacity;
+                }
+                begin_ = 0;
+                end_ = unread;
+            }
+            auto count = source_.read(buf_.get() + end_, chunk_size_);
+            end_ += count;
+            read_ += count;
+            if (stats_ != nullptr) {
+                stats_->bytes_read += count;
+            }
+            exhausted_ = count == 0;
+            return not exhausted_;
+        }
+
+        /// Reads until at least `size` bytes are buffered.
+        /// Returns `false` if the input ends before.
+        [[nodiscard]] auto fill_to(std::size_t size) -> bool
+        {
+            while (data().size() < size) {
+                if (not fill()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// Reads until `tag` is buffered.
+        /// Returns the position of `tag` within `data()`,
+        /// or `std::nullopt` if the input ends before it.
+        [[nodiscard]] auto find(std::string_view tag) -> std::optional<std::size_t>
+        {
+            PhaseGuard guard(stats_, ParseStats::Phase::Scan);
+            std::size_t scanned = 0;
+            auto pos = find_tag(data(), tag, 0);
+            while (pos == std::string_view::npos) {
+                scanned = std::max(scanned, data().size());
+                if (not fill()) {
+                    return std::nullopt;
+                }
+                pos = find_tag(data(), tag, std::max(scanned, tag.size()) - tag.size());
+            }
+            return pos;
+        }
+
+        /// Consumes all data before the next occurrence of `tag`.
+        /// Returns `false` if there is no such occurrence, in which case all data is consumed.
+        [[nodiscard]] auto seek(std::string_view tag) -> bool
+        {
+            PhaseGuard guard(stats_, ParseStats::Phase::Scan);
+            while (true) {
+                auto pos = find_tag(data(), tag, 0);
+                if (pos != std::string_view::npos) {
+                    consume(pos);
+                    return true;
+                }
+                auto size = data().size();
+                consume(size - std::min(size, tag.size() - 1));
+                if (not fill()) {
+                    begin_ = end_;
+                    return false;
+                }
+            }
+        }
+
+        /// Consumes whitespaces; returns `true` if there is nothing else left to read.
+        [[nodiscard]] auto eof() -> bool
+        {
+            PhaseGuard guard(stats_, ParseStats::Phase::Scan);
+            while (true) {
+                begin_ += skip_ws(data(), 0);
+                if (begin_ < end_) {
+                    return false;
+                }
+                if (not fill()) {
+                    return true;
+                }
+            }
+        }
+
+       private:
+        Source source_;
+        std::size_t chunk_size_;
+        std::unique_ptr<char[]> buf_{};
+        std::size_t capacity_ = 0;
+        std::size_t begin_ = 0;
+        std::size_t end_ = 0;
+        std::size_t read_ = 0;
+        std::size_t limit_ = std::numeric_limits<std::size_t>::max();
+        bool exhausted_ = false;
+        ParseStats *stats_ = nullptr;
+    };
+
+    [[nodiscard]] auto closing_tag(std::string const &tag) -> std::string
+    {
+        std::string ct;
+        ct.reserve(tag.size() + 3);
+        ct.push_back('<');
+        ct.push_back('/');
+        std::copy(tag.begin(), tag.end(), std::back_inserter(ct));
+        ct.push_back('>');
+        return ct;
+    }
+
+} // namespace detail
+
+/// Stream buffer reading another stream buffer ahead on a separate thread
+/// (see `detail::Prefetcher`), so that reading the input and parsing it overlap.
+class PrefetchingStreambuf : public std::streambuf {
+   public:
+    explicit PrefetchingStreambuf(std::streambuf *source,
+                                  std::size_t block_size = std::size_t{1} << 20,
+                                  std::size_t depth = 4)
+        : prefetcher_(
+            [source](char *out, std::size_t size) {
+                return static_cast<std::size_t>(
+                    source->sgetn(out, static_cast<std::streamsize>(size)));
+            },
+            block_size,
+            depth)
+    {
+    }
+
+   protected:
+    auto underflow() -> int_type override
+    {
+        if (gptr() == egptr() && not next_block()) {
+            return traits_type::eof();
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    auto xsgetn(char *out, std::streamsize count) -> std::streamsize override
+    {
+        std::streamsize total = 0;
+        while (total < count) {
+            if (gptr() == egptr() && not next_block()) {
+                break;
+            }
+            auto available =
+                std::min(count - total, static_cast<std::streamsize>(egptr() - gptr()));
+            std::memcpy(out + total, gptr(), static_cast<std::size_t>(available));
+            gbump(static_cast<int>(available));
+            total += available;
+        }
+        return total;
+    }
+
+   private:
+    [[nodiscard]] auto next_block() -> bool
+    {
+        auto size = prefetcher_.next();
+        setg(prefetcher_.data(), prefetcher_.data(), prefetcher_.data() + size);
+        return size > 0;
+    }
+
+    detail::Prefetcher prefetcher_;
+};
+
+/// Input stream reading another stream ahead; see `PrefetchingStreambuf`.
+///
+/// Read errors on the worker thread are reported by throwing.
+class PrefetchingIstream : public std::istream {
+   public:
+    explicit PrefetchingIstream(std::istream &source,
+                                std::size_t block_size = std::size_t{1} << 20,
+                                std::size_t depth = 4)
+        : std::istream(nullptr), buf_(source.rdbuf(), block_size, depth)
+    {
+        rdbuf(&buf_);
+        exceptions(std::ios::badbit);
+    }
+
+   private:
+    PrefetchingStreambuf buf_;
+};
+
+/// Stream buffer reading a source (see `IstreamSource`), so that sources can be used
+/// where a stream is expected, such as for decompression.
+///
+/// Bulk reads of at least the buffer size go directly to the source.
+template <typename Source>
+class SourceStreambuf : public std::streambuf {
+   public:
+    explicit SourceStreambuf(Source source, std::size_t buffer_size = std::size_t{1} << 16)
+        : source_(std::move(source)),
+          buffer_(new char[buffer_size]),
+          buffer_size_(buffer_size)
+    {
+    }
+
+   protected:
+    auto underflow() -> int_type override
+    {
+        if (gptr() == egptr()) {
+            auto count = source_.read(buffer_.get(), buffer_size_);
+            setg(buffer_.get(), buffer_.get(), buffer_.get() + count);
+            if (count == 0) {
+                return traits_type::eof();
+            }
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    auto xsgetn(char *out, std::streamsize count) -> std::streamsize override
+    {
+        std::streamsize total = 0;
+        while (total < count) {
+            auto left = count - total;
+            if (gptr() < egptr()) {
+                auto available = std::min(left, static_cast<std::streamsize>(egptr() - gptr()));
+                std::memcpy(out + total, gptr(), static_cast<std::size_t>(available));
+                gbump(static_cast<int>(available));
+                total += available;
+            } else if (static_cast<std::size_t>(left) >= buffer_size_) {
+                auto read = source_.read(out + total, static_cast<std::size_t>(left));
+                if (read == 0) {
+                    break;
+                }
+                total += static_cast<std::streamsize>(read);
+            } else if (underflow() == traits_type::eof()) {
+                break;
+            }
+        }
+        return total;
+    }
+
+   private:
+    Source source_;
+    std::unique_ptr<char[]> buffer_;
+    std::size_t buffer_size_;
+};
+
+template <typename R, typename Record_Handler, typename Error_Handler>
+auto match(R &&result, Record_Handler &&record_handler, Error_Handler &&error_handler)
+{
+    if (auto *record = std::get_if<0>(&result); record != nullptr) {
+        if constexpr (std::is_same_v<decltype(record_handler(*record)), void>) {
+            record_handler(*record);
+        } else {
+            return record_handler(*record);
+        }
+    } else {
+        auto *error = std::get_if<1>(&result);
+        if constexpr (std::is_same_v<decltype(error_handler(*error)), void>) {
+            error_handler(*error);
+        } else {
+            return error_handler(*error);
+        }
+    }
+}
+
+constexpr bool holds_record(Result const &result) { return std::holds_alternative<Record>(result); }
+constexpr bool holds_record(ViewResult const &result)
+{
+    return std::holds_alternative<RecordView>(result);
+}
+
+/// Returns an error with the rest of the line as context (see `detail::error_context`),
+/// which is left in the input.
+[[nodiscard]] auto consume_error(std::string const &tag, std::istream &is) -> Error
+{
+    std::string context;
+    while (context.size() < detail::ERROR_CONTEXT_SIZE and is.peek() != '\n'
+           and is.peek() != std::istream::traits_type::eof()) {
+        context.push_back(static_cast<char>(is.get()));
+    }
+    auto error = Error{"Could not consume " + tag + " in context: " + context};
+    for (auto pos = context.rbegin(); pos != context.rend(); ++pos) {
+        is.putback(*pos);
+    }
+    return error;
+}
+
+namespace text {
+
+    /// Default tags whose bodies make up the content of a trectext record.
+    ///
+    /// Tags are matched by a switch on their length, without hashing or allocating,
+    /// and the matcher is a template parameter of the parsers, so it is inlined.
+    struct DefaultContentTags {
+        static constexpr std::array<std::string_view, 10> tags = {
+            "TEXT", "HEADLINE", "TITLE", "HL", "HEAD", "TTL", "DD", "DATE", "LP", "LEADPARA"};
+
+        [[nodiscard]] constexpr auto operator()(std::string_view tag) const -> bool
+        {
+            switch (tag.size()) {
+            case 2:
+                return tag == "HL" or tag == "DD" or tag == "LP";
+            case 3:
+                return tag == "TTL";
+            case 4:
+                return tag == "TEXT" or tag == "HEAD" or tag == "DATE";
+            case 5:
+                return tag == "TITLE";
+            case 8:
+                return tag == "HEADLINE" or tag == "LEADPARA";
+            default:
+                return false;
+            }
+        }
+    };
+
+    /// Content tags chosen at runtime, for collections that use other tags than the default.
+    ///
+    /// A tag is first filtered by its length, using a bit mask,
+    /// and only then compared with the (few) tags of that length.
+    class ContentTags {
+       public:
+        ContentTags() = default;
+        explicit ContentTags(std::vector<std::string> tags) : tags_(std::move(tags))
+        {
+            for (auto const &tag : tags_) {
+                lengths_ |= length_bit(tag.size());
+            }
+        }
+
+        /// Returns the tags given as a comma-separated list, such as `TEXT,HEADLINE`.
+        [[nodiscard]] static auto parse(std::string_view names) -> ContentTags
+        {
+            std::vector<std::string> tags;
+            while (not names.empty()) {
+                auto comma = std::min(names.find(','), names.size());
+                if (comma > 0) {
+                    tags.emplace_back(names.substr(0, comma));
+                }
+                names.remove_prefix(std::min(comma + 1, names.size()));
+            }
+            return ContentTags(std::move(tags));
+        }
+
+        [[nodiscard]] auto operator()(std::string_view tag) const -> bool
+        {
+            if ((lengths_ & length_bit(tag.size())) == 0U) {
+                return false;
+            }
+            return std::find(tags_.begin(), tags_.end(), tag) != tags_.end();
+        }
+
+        [[nodiscard]] auto tags() const -> std::vector<std::string> const & { return tags_; }
+
+       private:
+        /// Lengths of 63 and more share the last bit.
+        [[nodiscard]] static auto length_bit(std::size_t length) -> std::uint64_t
+        {
+            return std::uint64_t{1} << std::min(length, std::size_t{63});
+        }
+
+        std::vector<std::string> tags_{};
+        std::uint64_t lengths_ = 0;
+    };
+
+    [[nodiscard]] auto read_record(std::istream &is) -> Result
+    {
+        if (not detail::consume(is, detail::DOC)) {
+            return consume_error(detail::DOC, is);
+        }
+        if (not detail::consume(is, detail::DOCNO)) {
+            return consume_error(detail::DOCNO, is);
+        }
+        is >> std::ws;
+        auto docno = detail::read_token(is);
+        is >> std::ws;
+        if (not detail::consume(is, detail::DOCNO_END)) {
+            return consume_error(detail::DOCNO_END, is);
+        }
+        std::string url = "";
+        std::ostringstream content;
+        while (not detail::consume(is, detail::DOC_END)) {
+            is >> std::ws;
+            auto tag = detail::consume(is);
+            if (not tag) {
+                return consume_error("any tag ", is);
+            }
+            auto closing_tag = detail::closing_tag(*tag);
+            auto body = detail::read_body(is, closing_tag);
+            if (not body) {
+                return consume_error(closing_tag, is);
+            }
+            if (tag == "URL") {
+                std::copy_if(body->begin(), body->end(), std::back_inserter(url), [](char ch) {
+                    return not std::isspace(ch);
+                });
+            } else if (DefaultContentTags{}(*tag)) {
+                content << *body;
+            }
+        }
+        return Record(std::move(docno), std::move(url), content.str());
+    }
+
+    [[nodiscard]] auto read_subsequent_record(std::istream &is) -> Result
+    {
+        return detail::read_subsequent_record(is, read_record);
+    }
+
+} // namespace text
+
+namespace detail {
+
+    /// Outcome of parsing a record from a buffer that may end before the record does.
+    enum class ParseStatus { Parsed, Failed, Incomplete };
+
+    /// Fields of a parsed trectext record.
+    ///
+    /// The docno points into the parsed data, while the URL and content are copied,
+    /// reusing the capacity of the strings from record to record.
+    struct TextFields {
+        std::string_view docno;
+        std::string url;
+        std::string content;
+        ParseError error;
+        /// Times copying the URL and content, unless null.
+        ParseStats *stats = nullptr;
+    };
+
+    /// Parses a trectext record beginning at `pos` in `data` into `fields`.
+    ///
+    /// If `eof` is `false`, `data` is assumed to be a prefix of a longer input,
+    /// and `ParseStatus::Incomplete` is returned if the record does not fit in it.
+    /// Otherwise, `pos` is moved past the record, or to the position of the error.
+    /// `record_size` is a hint used to reserve the content.
+    /// Without the URL and content in `projection`, the rest of the record is skipped
+    /// up to `</DOC>` without looking at its tags.
+    /// The content is made of the bodies of the tags for which `is_content_tag` is `true`.
+    template <typename IsContentTag = text::DefaultContentTags>
+    [[nodiscard]] auto parse_text(std::string_view data,
+                                  std::size_t &pos,
+                                  bool eof,
+                                  TextFields &fields,
+                                  std::size_t record_size = 0,
+                                  Fields projection = Fields::All,
+                                  IsContentTag const &is_content_tag = {}) -> ParseStatus
+    {
+        enum class Status { Consumed, Mismatch, Incomplete };
+        auto consume_error = [&](ErrorCode code, std::string_view tag = {}) {
+            fields.error = ParseError{code, pos, tag, error_context(data, pos)};
+            return ParseStatus::Failed;
+        };
+        auto fail = [&](Status status, ErrorCode code) {
+            if (status == Status::Incomplete) {
+                return ParseStatus::Incomplete;
+            }
+            return consume_error(code);
+        };
+        auto consume = [&](std::string_view tag) {
+            pos = skip_ws(data, pos);
+            auto prefix = data.substr(pos, tag.size());
+            if (prefix == tag) {
+                pos += tag.size();
+                return Status::Consumed;
+            }
+            if (not eof and prefix.size() < tag.size()
+                and tag.substr(0, prefix.size()) == prefix) {
+                return Status::Incomplete;
+            }
+            return Status::Mismatch;
+        };
+
+        if (auto status = consume(DOC); status != Status::Consumed) {
+            return fail(status, ErrorCode::MissingDoc);
+        }
+        if (auto status = consume(DOCNO); status != Status::Consumed) {
+            return fail(status, ErrorCode::MissingDocno);
+        }
+        pos = skip_ws(data, pos);
+        auto docno_end = std::find_if(data.begin() + pos, data.end(), [](unsigned char ch) {
+            return ch == '<' or is_space(ch);
+        });
+        if (docno_end == data.end() and not eof) {
+            return ParseStatus::Incomplete;
+        }
+        auto docno = data.substr(pos, std::distance(data.begin() + pos, docno_end));
+        pos += docno.size();
+        if (auto status = consume(DOCNO_END); status != Status::Consumed) {
+            return fail(status, ErrorCode::MissingDocnoEnd);
+        }
+
+        auto &url = fields.url;
+        auto &content = fields.content;
+        url.clear();
+        content.clear();
+        if (not has(projection, Fields::Url) and not has(projection, Fields::Content)) {
+            // If the hint is the position of the first `</DOC>` in `data`, start from there.
+            auto end = find_tag(data, DOC_END, std::max(pos, record_size));
+            if (end == std::string_view::npos) {
+                if (not eof) {
+                    return ParseStatus::Incomplete;
+                }
+                pos = data.size();
+                return consume_error(ErrorCode::MissingTag);
+            }
+            pos = end + DOC_END.size();
+            fields.docno = docno;
+            return ParseStatus::Parsed;
+        }
+        if (has(projection, Fields::Content)) {
+            content.reserve(record_size);
+        }
+        while (true) {
+            if (auto status = consume(DOC_END); status == Status::Consumed) {
+                break;
+            } else if (status == Status::Incomplete) {
+                return ParseStatus::Incomplete;
+            }
+            if (pos == data.size() and not eof) {
+                return ParseStatus::Incomplete;
+            }
+            if (pos == data.size() or data[pos] != '<') {
+                return consume_error(ErrorCode::MissingTag);
+            }
+            auto tag_end = data.find('>', pos + 1);
+            if (tag_end == std::string_view::npos) {
+                if (not eof) {
+                    return ParseStatus::Incomplete;
+                }
+                pos = data.size();
+                return consume_error(ErrorCode::MissingTag);
+            }
+            auto tag = data.substr(pos + 1, tag_end - pos - 1);
+            tag = tag.substr(0, skip_to_ws(tag, 0));
+            auto body_begin = tag_end + 1;
+            auto body_end = body_begin;
+            while (true) {
+                body_end = find_tag(data, "</", body_end);
+                if (body_end == std::string_view::npos) {
+                    if (not eof) {
+                        return ParseStatus::Incomplete;
+                    }
+                    pos = data.size();
+                    return consume_error(ErrorCode::MissingClosingTag, tag);
+                }
+                auto closing = data.substr(body_end + 2, tag.size() + 1);
+                if (closing.size() < tag.size() + 1 and not eof) {
+                    return ParseStatus::Incomplete;
+                }
+                if (closing.size() == tag.size() + 1 and closing.back() == '>'
+                    and closing.substr(0, tag.size()) == tag) {
+                    break;
+                }
+                ++body_end;
+            }
+            auto body = data.substr(body_begin, body_end - body_begin);
+            pos = body_end + tag.size() + 3;
+            if (tag == "URL") {
+                if (has(projection, Fields::Url)) {
+                    PhaseGuard guard(fields.stats, ParseStats::Phase::Copy);
+                    std::copy_if(body.begin(), body.end(), std::back_inserter(url), [](char ch) {
+                        return not is_space(ch);
+                    });
+                }
+            } else if (has(projection, Fields::Content) and is_content_tag(tag)) {
+                PhaseGuard guard(fields.stats, ParseStats::Phase::Copy);
+                content.append(body);
+            }
+        }
+        fields.docno = docno;
+        return ParseStatus::Parsed;
+    }
+
+    /// Moves parsed fields out to a `Result`.
+    [[nodiscard]] auto to_result(ParseStatus status, TextFields &fields) -> Result
+    {
+        if (status == ParseStatus::Failed) {
+            return fields.error.to_error();
+        }
+        return Record(std::string(fields.docno), std::move(fields.url), std::move(fields.content));
+    }
+
+    /// Parses a trecweb record, reporting a failure in `error`.
+    /// Parsing stops as soon as all fields in `projection` have been read.
+    /// The body ends at the first `</DOC>` after the header, unless `data` is a record split
+    /// by `next_record` with `web::Framing::ContentLength`, whose body ends at its last `</DOC>`.
+    [[nodiscard]] auto parse_web(std::string_view data,
+                                 ParseError &error,
+                                 Fields projection = Fields::All,
+                                 web::Framing framing = web::Framing::Scan)
+        -> std::optional<RecordView>
+    {
+        std::size_t pos = 0;
+        auto consume_error = [&](ErrorCode code, std::string const &tag) {
+            pos = std::min(pos, data.size());
+            error = ParseError{code, pos, {}, data.substr(pos, tag.size())};
+            return std::nullopt;
+        };
+        auto read_between = detail::read_between(data, pos);
+
+        auto docno = read_between(DOCNO, DOCNO_END);
+        if (not docno) {
+            return consume_error(ErrorCode::MissingDocno, DOCNO);
+        }
+        if (not has(projection, Fields::Url) and not has(projection, Fields::Content)
+            and not has(projection, Fields::Header)) {
+            return RecordView(*docno, {}, {});
+        }
+
+        auto dochdr = find_tag(data, DOCHDR, pos);
+        if (dochdr == std::string_view::npos) {
+            return consume_error(ErrorCode::MissingDochdr, DOCHDR);
+        }
+        pos = dochdr + DOCHDR.size();
+        auto url = read_token(data, pos);
+        if (not has(projection, Fields::Content) and not has(projection, Fields::Header)) {
+            return RecordView(*docno, url, {});
+        }
+        if (not has(projection, Fields::Url)) {
+            url = {};
+        }
+
+        auto header_begin = pos;
+        auto header_end = find_tag(data, DOCHDR_END, pos);
+        if (header_end == std::string_view::npos) {
+            return consume_error(ErrorCode::MissingDochdrEnd, DOCHDR_END);
+        }
+        std::string_view header{};
+        if (has(projection, Fields::Header)) {
+            header = data.substr(header_begin, header_end - header_begin);
+        }
+        if (not has(projection, Fields::Content)) {
+            return RecordView(*docno, url, {}, header);
+        }
+
+        // Records split with `web::Framing::ContentLength` end with the `</DOC>` that
+        // ends the body, which may contain others.
+        auto body_begin = header_end + DOCHDR_END.size();
+        auto body_end = framing == web::Framing::ContentLength
+                                and data.size() >= body_begin + DOC_END.size()
+                                and data.substr(data.size() - DOC_END.size()) == DOC_END
+                            ? data.size() - DOC_END.size()
+                            : find_tag(data, DOC_END, body_begin);
+        if (body_end == std::string_view::npos) {
+            pos = body_begin;
+            return consume_error(ErrorCode::UnterminatedRecord, DOC_END);
+        }
+        return RecordView(
+            *docno, url, data.substr(body_begin, body_end - body_begin), header);
+    }
+
+} // namespace detail
+
+namespace text {
+
+    /// Parses a single trectext record from a buffer,
+    /// with the content made of the tags matched by `content_tags`.
+    template <typename Tags = DefaultContentTags>
+    [[nodiscard]] auto parse(std::string_view data,
+                             Fields projection = Fields::All,
+                             Tags const &content_tags = {}) -> Result
+    {
+        std::size_t pos = 0;
+        detail::TextFields fields;
+        return detail::to_result(
+            detail::parse_text(data, pos, true, fields, 0, projection, content_tags), fields);
+    }
+
+    /// Buffered trectext parser.
+    ///
+    /// It produces the same records as `read_subsequent_record`,
+    /// but scans for tags in a buffer instead of reading the input one character at a time.
+    /// `Tags` matches the tags making up the content: `DefaultContentTags`, `ContentTags`,
+    /// or any other `bool(std::string_view) const` function object.
+    /// The input is read from a `Source`, such as `IstreamSource` or `FdSource`.
+    template <typename Tags, typename Source = IstreamSource>
+    class BasicTrecParser {
+       public:
+        /// Records are buffered by reading the input in chunks of at least
+        /// `batch_size` bytes, rounded up to a power of two.
+        /// Only fields in `projection` are extracted.
+        BasicTrecParser(Source input,
+                        std::size_t batch_size = 10000,
+                        Fields projection = Fields::All,
+                        Tags content_tags = {})
+            : buffer_(std::move(input), batch_size),
+              projection_(projection),
+              content_tags_(std::move(content_tags))
+        {
+        }
+        [[nodiscard]] auto operator()() -> Result { return read_record(); }
 
-        pos = data.find(detail::DOCHDR, pos);
-        if (pos == std::string_view::npos) {
-            return consume_error(detail::DOCHDR);
+        /// Reads the next record, skipping any data before its `<DOC>` tag.
+        [[nodiscard]] auto read_record() -> Result
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            if (not seek_record()) {
+                return Error{"EOF"};
+            }
+            auto status = parse_next();
+            detail::PhaseGuard copy_guard(stats_, ParseStats::Phase::Copy);
+            return detail::to_result(status, fields_);
         }
-        pos += detail::DOCHDR.size();
-        auto url = detail::read_token(data, pos);
 
-        auto body = read_between(detail::DOCHDR_END, detail::DOC_END);
-        if (not docno) {
-            return consume_error(detail::DOCNO);
+        /// Reads the next record into `record`, reusing its memory; see `read_record()`.
+        /// Returns the error if no record could be read.
+        [[nodiscard]] auto read_record(Record &record) -> std::optional<Error>
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            if (not seek_record()) {
+                return Error{"EOF"};
+            }
+            if (parse_next() != detail::ParseStatus::Parsed) {
+                return fields_.error.to_error();
+            }
+            detail::PhaseGuard copy_guard(stats_, ParseStats::Phase::Copy);
+            record.assign(fields_.docno, fields_.url, fields_.content);
+            return std::nullopt;
+        }
+
+        /// Reads up to `count` records into `batch`, replacing its previous contents
+        /// but reusing its memory. Returns the number of records read.
+        auto read_batch(RecordBatch &batch, std::size_t count) -> std::size_t
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            batch.clear();
+            while (batch.size() < count and seek_record()) {
+                if (parse_next() == detail::ParseStatus::Parsed) {
+                    detail::PhaseGuard copy_guard(stats_, ParseStats::Phase::Copy);
+                    batch.push_back(fields_.docno, fields_.url, fields_.content);
+                } else {
+                    batch.push_back_error(fields_.error.to_error());
+                }
+            }
+            return batch.size();
+        }
+
+        /// Reads up to `count` records.
+        [[nodiscard]] auto read_batch(std::size_t count) -> RecordBatch
+        {
+            RecordBatch batch;
+            read_batch(batch, count);
+            return batch;
+        }
+
+        /// Reads all remaining records, calling `on_record(RecordView const &)` for each record
+        /// and `on_error(ParseError const &)` for each error.
+        /// The arguments point into the buffer, and are valid only until the call returns.
+        template <typename OnRecord, typename OnError>
+        void parse_all(OnRecord &&on_record, OnError &&on_error)
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            while (seek_record()) {
+                auto offset = buffer_.offset();
+                auto status = parse_next();
+                detail::PhaseGuard callback_guard(stats_, ParseStats::Phase::Other);
+                if (status == detail::ParseStatus::Parsed) {
+                    on_record(RecordView(fields_.docno, fields_.url, fields_.content));
+                } else {
+                    fields_.error.offset += offset;
+                    on_error(static_cast<ParseError const &>(fields_.error));
+                }
+            }
+        }
+
+        /// Returns `true` if there is nothing but whitespace left to read,
+        /// or nothing within the byte range and record limit.
+        [[nodiscard]] auto eof() -> bool
+        {
+            // The rest of an oversize record is skipped.
+            if (std::exchange(oversize_, false) and not buffer_.seek(detail::DOC)) {
+                return true;
+            }
+            return past_end() or buffer_.eof();
+        }
+
+        /// Collects statistics into `stats`, or stops collecting them if it is null.
+        /// `stats` must outlive the parser, or be replaced before it is destroyed.
+        void set_stats(ParseStats *stats)
+        {
+            stats_ = stats;
+            buffer_.set_stats(stats);
+            fields_.stats = stats;
+        }
+
+        /// Limits the size of records to `size` bytes, which bounds the memory used
+        /// by the parser. Larger records, from `<DOC>` to `</DOC>`, are reported as
+        /// `ErrorCode::OversizeRecord` whether or not they happen to be read as a whole,
+        /// and are skipped without buffering more than the limit; parsing resumes
+        /// at the next `<DOC>`.
+        void set_max_record_size(std::size_t size) { buffer_.set_limit(size); }
+
+        /// Restricts parsing to the records whose `<DOC>` begins within `length` bytes
+        /// from `offset` in the input. The first `offset` bytes are skipped, without reading
+        /// them if the source can seek, so consecutive ranges split the records of a file
+        /// without overlap, whatever the records the boundaries fall into.
+        /// Must be called before reading.
+        void set_byte_range(std::size_t offset, std::size_t length)
+        {
+            buffer_.skip(offset);
+            range_end_
+                = offset + std::min(length, std::numeric_limits<std::size_t>::max() - offset);
+        }
+
+        /// Stops after `count` more records have been read.
+        void set_record_limit(std::size_t count) { remaining_ = count; }
+
+        /// Skips the next `count` records, and any invalid records among them, without
+        /// extracting their content. Skipped records do not count towards the limit.
+        /// Returns the number of records skipped, fewer only at the end of the input.
+        auto skip(std::size_t count) -> std::size_t
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            auto projection = std::exchange(projection_, Fields::Docno);
+            auto remaining = std::exchange(remaining_, std::numeric_limits<std::size_t>::max());
+            std::size_t skipped = 0;
+            while (skipped < count and seek_record()) {
+                if (parse_next() == detail::ParseStatus::Parsed) {
+                    ++skipped;
+                }
+            }
+            projection_ = projection;
+            remaining_ = remaining;
+            return skipped;
+        }
+
+       private:
+        /// Returns `true` if the record limit has been reached,
+        /// or if the next `<DOC>` begins past the byte range.
+        [[nodiscard]] auto past_end() -> bool
+        {
+            if (remaining_ == 0) {
+                return true;
+            }
+            if (range_end_ == std::numeric_limits<std::size_t>::max()) {
+                return false;
+            }
+            auto pos = buffer_.find(detail::DOC);
+            return pos and buffer_.offset() + *pos >= range_end_;
+        }
+
+        /// Consumes the data before the next `<DOC>`.
+        /// Returns `false` if there is none, or if it is past the end; see `past_end`.
+        [[nodiscard]] auto seek_record() -> bool
+        {
+            oversize_ = false;
+            return not past_end() and buffer_.seek(detail::DOC);
+        }
+
+        /// Parses the record at the beginning of the buffer into `fields_`.
+        /// The docno points into the buffer, and remains valid until the buffer is filled again.
+        [[nodiscard]] auto parse_next() -> detail::ParseStatus
+        {
+            auto record_size = buffer_.find(detail::DOC_END);
+            while (true) {
+                std::size_t pos = 0;
+                auto status = detail::ParseStatus::Incomplete;
+                if (record_size and *record_size + detail::DOC_END.size() > buffer_.limit()) {
+                    // Buffered, but larger than the limit nonetheless.
+                    fields_.error = ParseError{ErrorCode::OversizeRecord,
+                                               0,
+                                               {},
+                                               detail::record_context(buffer_.data(), 0)};
+                    pos = *record_size + detail::DOC_END.size();
+                    status = detail::ParseStatus::Failed;
+                } else {
+                    status = detail::parse_text(buffer_.data(),
+                                                pos,
+                                                buffer_.exhausted(),
+                                                fields_,
+                                                record_size.value_or(0),
+                                                projection_,
+                                                content_tags_);
+                }
+                if (status == detail::ParseStatus::Incomplete and buffer_.full()) {
+                    // The rest of the record is skipped by the next `seek`, or by `eof`.
+                    auto data = buffer_.data();
+                    fields_.error = ParseError{
+                        ErrorCode::OversizeRecord, 0, {}, detail::record_context(data, 0)};
+                    pos = std::min(detail::find_tag(data, detail::DOC, 1), data.size());
+                    status = detail::ParseStatus::Failed;
+                    oversize_ = true;
+                }
+                if (status != detail::ParseStatus::Incomplete) {
+                    buffer_.consume(pos);
+                    if (status == detail::ParseStatus::Parsed) {
+                        --remaining_;
+                    }
+                    if (stats_ != nullptr) {
+                        if (status == detail::ParseStatus::Parsed) {
+                            stats_->count_record(pos);
+                        } else {
+                            stats_->count_error(fields_.error.code);
+                        }
+                    }
+                    return status;
+                }
+                (void)buffer_.fill();
+            }
+        }
+
+        detail::ReadBuffer<Source> buffer_;
+        Fields projection_;
+        Tags content_tags_;
+        detail::TextFields fields_{};
+        ParseStats *stats_ = nullptr;
+        /// Whether the rest of an oversize record is left to skip; see `parse_next`.
+        bool oversize_ = false;
+        /// Offset in the input past which records are not read; see `set_byte_range`.
+        std::size_t range_end_ = std::numeric_limits<std::size_t>::max();
+        /// Number of records left to read; see `set_record_limit`.
+        std::size_t remaining_ = std::numeric_limits<std::size_t>::max();
+    };
+
+    using TrecParser = BasicTrecParser<DefaultContentTags>;
+
+    /// Returns the range of the records read from `input`; see `RecordRange`.
+    [[nodiscard]] auto records(std::istream &input,
+                               std::function<void(Error const &)> on_error = {},
+                               std::size_t batch_size = 10000,
+                               Fields projection = Fields::All) -> RecordRange<TrecParser>
+    {
+        return RecordRange<TrecParser>(TrecParser(input, batch_size, projection),
+                                       std::move(on_error));
+    }
+
+    /// Reads all records from `input`; see `BasicTrecParser::parse_all`.
+    template <typename OnRecord, typename OnError, typename Tags = DefaultContentTags>
+    void parse_all(std::istream &input,
+                   OnRecord &&on_record,
+                   OnError &&on_error,
+                   std::size_t batch_size = 10000,
+                   Fields projection = Fields::All,
+                   Tags content_tags = {})
+    {
+        BasicTrecParser<Tags> parser(input, batch_size, projection, std::move(content_tags));
+        parser.parse_all(std::forward<OnRecord>(on_record), std::forward<OnError>(on_error));
+    }
+
+    /// Parses all records in `data`; see `BasicTrecParser::parse_all`.
+    /// Error offsets are relative to the beginning of `data`.
+    template <typename OnRecord, typename OnError, typename Tags = DefaultContentTags>
+    void parse_all(std::string_view data,
+                   OnRecord &&on_record,
+                   OnError &&on_error,
+                   Fields projection = Fields::All,
+                   Tags const &content_tags = {})
+    {
+        detail::TextFields fields;
+        std::size_t pos = detail::find_tag(data, detail::DOC, 0);
+        while (pos != std::string_view::npos) {
+            if (detail::parse_text(data, pos, true, fields, 0, projection, content_tags)
+                == detail::ParseStatus::Parsed) {
+                on_record(RecordView(fields.docno, fields.url, fields.content));
+            } else {
+                on_error(static_cast<ParseError const &>(fields.error));
+            }
+            pos = detail::find_tag(data, detail::DOC, pos);
+        }
+    }
+
+}
+
+namespace web {
+
+    /// Parses a single trecweb record. With `Framing::ContentLength`, `data` must be
+    /// a whole record as split with that framing, whose body ends at its last `</DOC>`.
+    [[nodiscard]] auto parse_view(std::string_view data,
+                                  Fields projection = Fields::All,
+                                  Framing framing = Framing::Scan) -> ViewResult
+    {
+        ParseError error;
+        if (auto record = detail::parse_web(data, error, projection, framing); record) {
+            return *record;
+        }
+        return error.to_error();
+    }
+
+    /// Parses a single trecweb record into a `Record`; see `parse_view`.
+    [[nodiscard]] auto parse(std::string_view data,
+                             Fields projection = Fields::All,
+                             Framing framing = Framing::Scan) -> Result
+    {
+        auto result = parse_view(data, projection, framing);
+        if (auto *view = std::get_if<RecordView>(&result); view != nullptr) {
+            return view->to_record();
         }
-        return Record(std::string(*docno), std::string(url), std::string(*body));
+        return std::get<Error>(std::move(result));
     }
 
-    class TrecParser {
+    /// Buffered trecweb parser, reading its input from a `Source`,
+    /// such as `IstreamSource` or `FdSource`.
+    template <typename Source>
+    class BasicTrecParser {
        public:
-        TrecParser(std::istream &input, std::size_t batch_size = 10000)
-            : input_(input), batch_size_(batch_size)
+        /// Records are buffered by reading the input in chunks of at least
+        /// `batch_size` bytes, rounded up to a power of two.
+        /// Only fields in `projection` are extracted, and records end according to `framing`.
+        BasicTrecParser(Source input,
+                        std::size_t batch_size = 10000,
+                        Fields projection = Fields::All,
+                        Framing framing = Framing::Scan)
+            : buffer_(std::move(input), batch_size), projection_(projection), framing_(framing)
         {
         }
         [[nodiscard]] auto operator()() -> Result { return read_record(); }
         [[nodiscard]] auto read_record() -> Result
         {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
             auto view = read_enough();
             if (not view) {
+                discard_rest();
                 return Error{"EOF"};
-            } else {
-                auto res = web::parse(*view);
-                buf_.erase(buf_.begin(), buf_.begin() + view->size());
-                return res;
             }
+            ParseError error;
+            auto record = parse_next(*view, error);
+            buffer_.consume(view->size());
+            if (not record) {
+                return error.to_error();
+            }
+            detail::PhaseGuard copy_guard(stats_, ParseStats::Phase::Copy);
+            return record->to_record();
+        }
+        /// Reads the next record into `record`, reusing its memory.
+        /// Returns the error if no record could be read.
+        [[nodiscard]] auto read_record(Record &record) -> std::optional<Error>
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            auto view = read_enough();
+            if (not view) {
+                discard_rest();
+                return Error{"EOF"};
+            }
+            ParseError error;
+            auto parsed = parse_next(*view, error);
+            if (parsed) {
+                detail::PhaseGuard copy_guard(stats_, ParseStats::Phase::Copy);
+                record.assign(parsed->trecid(), parsed->url(), parsed->content());
+            }
+            buffer_.consume(view->size());
+            if (not parsed) {
+                return error.to_error();
+            }
+            return std::nullopt;
+        }
+        /// Reads up to `count` records into `batch`, replacing its previous contents
+        /// but reusing its memory. Returns the number of records read.
+        /// Trailing data without `</DOC>` is reported as `ErrorCode::UnterminatedRecord`.
+        auto read_batch(RecordBatch &batch, std::size_t count) -> std::size_t
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            batch.clear();
+            ParseError error;
+            while (batch.size() < count) {
+                auto view = read_enough();
+                if (not view) {
+                    if (not past_end() and not buffer_.eof()) {
+                        if (stats_ != nullptr) {
+                            stats_->count_error(ErrorCode::UnterminatedRecord);
+                        }
+                        batch.push_back_error(
+                            ParseError{ErrorCode::UnterminatedRecord,
+                                       buffer_.offset(),
+                                       {},
+                                       detail::error_context(buffer_.data(), 0)}
+                                .to_error());
+                    }
+                    discard_rest();
+                    break;
+                }
+                if (auto record = parse_next(*view, error); record) {
+                    detail::PhaseGuard copy_guard(stats_, ParseStats::Phase::Copy);
+                    batch.push_back(*record);
+                } else {
+                    batch.push_back_error(error.to_error());
+                }
+                buffer_.consume(view->size());
+            }
+            return batch.size();
+        }
+        /// Reads up to `count` records.
+        [[nodiscard]] auto read_batch(std::size_t count) -> RecordBatch
+        {
+            RecordBatch batch;
+            read_batch(batch, count);
+            return batch;
+        }
+        /// Reads all remaining records, calling `on_record(RecordView const &)` for each record
+        /// and `on_error(ParseError const &)` for each error.
+        /// The arguments point into the buffer, and are valid only until the call returns.
+        /// Trailing data without `</DOC>` is reported as `ErrorCode::UnterminatedRecord`.
+        template <typename OnRecord, typename OnError>
+        void parse_all(OnRecord &&on_record, OnError &&on_error)
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            ParseError error;
+            while (auto view = read_enough()) {
+                auto record = parse_next(*view, error);
+                {
+                    detail::PhaseGuard callback_guard(stats_, ParseStats::Phase::Other);
+                    if (record) {
+                        on_record(static_cast<RecordView const &>(*record));
+                    } else {
+                        error.offset += buffer_.offset();
+                        on_error(static_cast<ParseError const &>(error));
+                    }
+                }
+                buffer_.consume(view->size());
+            }
+            if (not past_end() and not buffer_.eof()) {
+                auto rest = buffer_.data();
+                if (stats_ != nullptr) {
+                    stats_->count_error(ErrorCode::UnterminatedRecord);
+                }
+                detail::PhaseGuard callback_guard(stats_, ParseStats::Phase::Other);
+                on_error(ParseError{ErrorCode::UnterminatedRecord,
+                                    buffer_.offset(),
+                                    {},
+                                    detail::error_context(rest, 0)});
+                buffer_.consume(rest.size());
+            }
+        }
+        /// Returns `true` if there is nothing but whitespace left to read,
+        /// or nothing within the byte range and record limit.
+        [[nodiscard]] auto eof() -> bool
+        {
+            // The rest of an oversize record is skipped.
+            if (std::exchange(oversize_, false) and not buffer_.seek(detail::DOC)) {
+                return true;
+            }
+            return past_end() or buffer_.eof();
+        }
+
+        /// Collects statistics into `stats`, or stops collecting them if it is null.
+        /// `stats` must outlive the parser, or be replaced before it is destroyed.
+        void set_stats(ParseStats *stats)
+        {
+            stats_ = stats;
+            buffer_.set_stats(stats);
+        }
+
+        /// Reads the next record without buffering its content as a whole.
+        ///
+        /// It calls `on_head(RecordView const &)` with the docno, URL, and HTTP header,
+        /// and then `on_content(std::string_view)` with consecutive chunks of the content
+        /// as they are read, up to the first `</DOC>` whatever the framing.
+        /// Only the record up to `</DOCHDR>` must fit in the buffer (and within
+        /// `set_max_record_size`), so memory does not depend on the size of the content.
+        /// Records that cannot be parsed up to `</DOCHDR>` are read as a whole,
+        /// and fail as in `read_record`.
+        /// The arguments point into the buffer, and are valid only until the call returns.
+        /// Returns the error if no record could be read; an error after `on_head` has been
+        /// called means that the input ended before `</DOC>`.
+        template <typename OnHead, typename OnContent>
+        [[nodiscard]] auto stream_record(OnHead &&on_head, OnContent &&on_content)
+            -> std::optional<Error>
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            ParseError error;
+            std::optional<RecordView> head = std::nullopt;
+            auto body_begin = read_head();
+            if (body_begin) {
+                head = detail::parse_web(buffer_.data().substr(0, *body_begin),
+                                         error,
+                                         Fields::Docno | Fields::Url | Fields::Header);
+            }
+            if (not head) {
+                auto view = read_enough();
+                if (not view) {
+                    discard_rest();
+                    return Error{"EOF"};
+                }
+                auto record = parse_next(*view, error);
+                if (record) {
+                    detail::PhaseGuard callback_guard(stats_, ParseStats::Phase::Other);
+                    on_head(RecordView(
+                        record->trecid(), record->url(), {}, record->header().data()));
+                    on_content(record->content());
+                }
+                buffer_.consume(view->size());
+                if (not record) {
+                    return error.to_error();
+                }
+                return std::nullopt;
+            }
+            // Kept in case the record is unterminated, when the buffer has been refilled.
+            context_.assign(detail::record_context(buffer_.data(), 0));
+            --remaining_;
+            {
+                detail::PhaseGuard callback_guard(stats_, ParseStats::Phase::Other);
+                on_head(static_cast<RecordView const &>(*head));
+            }
+            buffer_.consume(*body_begin);
+            auto size = *body_begin;
+            while (true) {
+                auto data = buffer_.data();
+                auto end = detail::find_tag(data, detail::DOC_END, 0);
+                // The end of the data may be the beginning of `</DOC>`.
+                auto chunk = data.substr(0,
+                                         end != std::string_view::npos
+                                             ? end
+                                             : data.size()
+                                                   - std::min(data.size(),
+                                                              detail::DOC_END.size() - 1));
+                if (not chunk.empty()) {
+                    detail::PhaseGuard callback_guard(stats_, ParseStats::Phase::Other);
+                    on_content(chunk);
+                }
+                buffer_.consume(chunk.size());
+                size += chunk.size();
+                if (end != std::string_view::npos) {
+                    buffer_.consume(detail::DOC_END.size());
+                    if (stats_ != nullptr) {
+                        stats_->count_record(size + detail::DOC_END.size());
+                    }
+                    return std::nullopt;
+                }
+                if (not buffer_.fill()) {
+                    break;
+                }
+            }
+            auto rest = buffer_.data();
+            if (not rest.empty()) {
+                detail::PhaseGuard callback_guard(stats_, ParseStats::Phase::Other);
+                on_content(rest);
+            }
+            if (stats_ != nullptr) {
+                stats_->count_error(ErrorCode::UnterminatedRecord);
+            }
+            buffer_.consume(rest.size());
+            return ParseError{ErrorCode::UnterminatedRecord, 0, {}, context_}.to_error();
+        }
+
+        /// Limits the size of records to `size` bytes, which bounds the memory used
+        /// by the parser. Larger records, from `<DOC>` to `</DOC>`, are reported as
+        /// `ErrorCode::OversizeRecord` whether or not they happen to be read as a whole,
+        /// and are skipped without buffering more than the limit; parsing resumes
+        /// at the next `<DOC>`.
+        void set_max_record_size(std::size_t size) { buffer_.set_limit(size); }
+
+        /// Restricts parsing to the records whose `<DOC>` begins within `length` bytes
+        /// from `offset` in the input. The first `offset` bytes are skipped, without reading
+        /// them if the source can seek, and so is the rest of any record they end in,
+        /// so consecutive ranges split the records of a file without overlap.
+        /// Must be called before reading.
+        void set_byte_range(std::size_t offset, std::size_t length)
+        {
+            if (buffer_.skip(offset) > 0) {
+                (void)buffer_.seek(detail::DOC);
+            }
+            range_end_
+                = offset + std::min(length, std::numeric_limits<std::size_t>::max() - offset);
+        }
+
+        /// Stops after `count` more records have been read.
+        void set_record_limit(std::size_t count) { remaining_ = count; }
+
+        /// Skips the next `count` records, and any invalid records among them, without
+        /// extracting their content. Skipped records do not count towards the limit.
+        /// Returns the number of records skipped, fewer only at the end of the input.
+        auto skip(std::size_t count) -> std::size_t
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Parse);
+            auto projection = std::exchange(projection_, Fields::Docno);
+            auto remaining = std::exchange(remaining_, std::numeric_limits<std::size_t>::max());
+            ParseError error;
+            std::size_t skipped = 0;
+            while (skipped < count) {
+                auto view = read_enough();
+                if (not view) {
+                    break;
+                }
+                if (parse_next(*view, error)) {
+                    ++skipped;
+                }
+                buffer_.consume(view->size());
+            }
+            projection_ = projection;
+            remaining_ = remaining;
+            return skipped;
         }
 
        private:
+        /// Returns `true` if the record limit has been reached,
+        /// or if the next `<DOC>` begins past the byte range.
+        [[nodiscard]] auto past_end() -> bool
+        {
+            if (remaining_ == 0) {
+                return true;
+            }
+            if (range_end_ == std::numeric_limits<std::size_t>::max()) {
+                return false;
+            }
+            auto pos = buffer_.find(detail::DOC);
+            return pos and buffer_.offset() + *pos >= range_end_;
+        }
+
+        /// Consumes the rest of the input when no more records can be read from it,
+        /// unless reading stopped at the end of the byte range or at the record limit.
+        void discard_rest()
+        {
+            if (not past_end()) {
+                buffer_.consume(buffer_.data().size());
+            }
+        }
+
+        /// Reads the next record up to the end of its HTTP header.
+        /// Returns the position where its body begins, or `std::nullopt` if the header
+        /// cannot be read or a `</DOC>` comes before it.
+        [[nodiscard]] auto read_head() -> std::optional<std::size_t>
+        {
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Scan);
+            if ((std::exchange(oversize_, false) and not buffer_.seek(detail::DOC))
+                or past_end()) {
+                return std::nullopt;
+            }
+            auto header_end = buffer_.find(detail::DOCHDR_END);
+            if (not header_end
+                or detail::find_tag(buffer_.data().substr(0, *header_end), detail::DOC_END, 0)
+                       != std::string_view::npos) {
+                return std::nullopt;
+            }
+            return *header_end + detail::DOCHDR_END.size();
+        }
+
+        /// Parses a buffered record, counting it in the statistics.
+        [[nodiscard]] auto parse_next(std::string_view view, ParseError &error)
+            -> std::optional<RecordView>
+        {
+            std::optional<RecordView> record = std::nullopt;
+            if (oversize_) {
+                auto doc = std::min(detail::find_tag(view, detail::DOC, 0), view.size());
+                error = ParseError{
+                    ErrorCode::OversizeRecord, doc, {}, detail::record_context(view, doc)};
+            } else {
+                record = detail::parse_web(view, error, projection_, framing_);
+            }
+            if (record) {
+                --remaining_;
+            }
+            if (stats_ != nullptr) {
+                if (record) {
+                    stats_->count_record(view.size());
+                } else {
+                    stats_->count_error(error.code);
+                }
+            }
+            return record;
+        }
+
         /// Reads at least enough to buffer the next record.
         /// It returns `std::nullopt` if the next record cannot be read.
+        /// If the record is larger than the limit, `oversize_` is set, and the view is
+        /// of the whole record if it is buffered, or else of its beginning,
+        /// or of the data up to the next `<DOC>` in the buffer.
         [[nodiscard]] auto read_enough() -> std::optional<std::string_view>
         {
-            std::string_view view(&buf_[0], buf_.size());
-            auto pos = view.find(detail::DOC_END);
-            while (pos == std::string_view::npos) {
-                auto old_size = buf_.size();
-                buf_.resize(buf_.size() + batch_size_);
-                input_.read(&buf_[old_size], batch_size_);
-                if (input_.gcount() == 0) {
-                    return std::nullopt;
+            detail::PhaseGuard guard(stats_, ParseStats::Phase::Scan);
+            // The rest of an oversize record is skipped.
+            if ((std::exchange(oversize_, false) and not buffer_.seek(detail::DOC))
+                or past_end()) {
+                return std::nullopt;
+            }
+            std::optional<std::size_t> end = std::nullopt;
+            if (framing_ == Framing::ContentLength) {
+                end = read_framed();
+            }
+            if (not end) {
+                auto pos = buffer_.find(detail::DOC_END);
+                if (not pos) {
+                    if (not buffer_.full()) {
+                        return std::nullopt;
+                    }
+                    auto data = buffer_.data();
+                    auto doc = std::min(detail::find_tag(data, detail::DOC, 0), data.size());
+                    oversize_ = true;
+                    return data.substr(0, detail::find_tag(data, detail::DOC, doc + 1));
+                }
+                end = *pos + detail::DOC_END.size();
+            }
+            auto data = buffer_.data().substr(0, *end);
+            if (*end > buffer_.limit()) {
+                auto doc = std::min(detail::find_tag(data, detail::DOC, 0), data.size());
+                oversize_ = *end - doc > buffer_.limit();
+            }
+            return data;
+        }
+
+        /// Reads the next record up to the end given by its `Content-Length`.
+        /// Returns the end of the record, or `std::nullopt` if it must be scanned for.
+        [[nodiscard]] auto read_framed() -> std::optional<std::size_t>
+        {
+            if (not buffer_.find(detail::DOCHDR_END)) {
+                return std::nullopt;
+            }
+            std::size_t header_end = 0;
+            auto body_end = detail::content_end(buffer_.data(), 0, header_end);
+            if (not body_end or not buffer_.fill_to(*body_end + detail::DOC_END.size())) {
+                return std::nullopt;
+            }
+            auto end = detail::verify_record_end(buffer_.data(), *body_end);
+            if (end == std::string_view::npos) {
+                return std::nullopt;
+            }
+            return end;
+        }
+
+        detail::ReadBuffer<Source> buffer_;
+        Fields projection_;
+        Framing framing_;
+        ParseStats *stats_ = nullptr;
+        /// Whether the last record was too large, and the rest of it is left to skip;
+        /// see `read_enough`.
+        bool oversize_ = false;
+        /// Context of the record being streamed; see `stream_record`.
+        std::string context_{};
+        /// Offset in the input past which records are not read; see `set_byte_range`.
+        std::size_t range_end_ = std::numeric_limits<std::size_t>::max();
+        /// Number of records left to read; see `set_record_limit`.
+        std::size_t remaining_ = std::numeric_limits<std::size_t>::max();
+    };
+
+    using TrecParser = BasicTrecParser<IstreamSource>;
+
+    /// Returns the range of the records read from `input`; see `RecordRange`.
+    [[nodiscard]] auto records(std::istream &input,
+                               std::function<void(Error const &)> on_error = {},
+                               std::size_t batch_size = 10000,
+                               Fields projection = Fields::All) -> RecordRange<TrecParser>
+    {
+        return RecordRange<TrecParser>(TrecParser(input, batch_size, projection),
+                                       std::move(on_error));
+    }
+
+    /// Reads all records from `input`; see `TrecParser::parse_all`.
+    template <typename OnRecord, typename OnError>
+    void parse_all(std::istream &input,
+                   OnRecord &&on_record,
+                   OnError &&on_error,
+                   std::size_t batch_size = 10000,
+                   Fields projection = Fields::All,
+                   Framing framing = Framing::Scan)
+    {
+        TrecParser parser(input, batch_size, projection, framing);
+        parser.parse_all(std::forward<OnRecord>(on_record), std::forward<OnError>(on_error));
+    }
+
+    /// Parses all records in `data`, such as a `MappedFile`; see `TrecParser::parse_all`.
+    /// Records point into `data`, and error offsets are relative to its beginning.
+    template <typename OnRecord, typename OnError>
+    void parse_all(std::string_view data,
+                   OnRecord &&on_record,
+                   OnError &&on_error,
+                   Fields projection = Fields::All,
+                   Framing framing = Framing::Scan)
+    {
+        ParseError error;
+        std::size_t pos = 0;
+        while (auto view = detail::next_record(data, pos, framing)) {
+            if (auto record = detail::parse_web(*view, error, projection, framing); record) {
+                on_record(static_cast<RecordView const &>(*record));
+            } else {
+                error.offset += view->data() - data.data();
+                on_error(static_cast<ParseError const &>(error));
+            }
+        }
+        if (pos = detail::skip_ws(data, pos); pos < data.size()) {
+            on_error(ParseError{
+                ErrorCode::UnterminatedRecord, pos, {}, detail::error_context(data, pos)});
+        }
+    }
+
+    /// Parses all records in `data` on `threads` worker threads.
+    ///
+    /// The data is split into ranges of `range_size` bytes aligned to record boundaries
+    /// (see `detail::split_records`), and each range is parsed independently.
+    /// `fn` is called on the calling thread with each `Result`, in the original order.
+    /// At most `threads` ranges are being parsed or waiting to be consumed at once.
+    /// Unlike `TrecParser`, no error is reported for trailing data without `</DOC>`.
+    /// With `Framing::ContentLength`, the ranges are still split at scanned `</DOC>` tags.
+    template <typename Fn>
+    void parse_parallel(std::string_view data,
+                        std::size_t threads,
+                        Fn &&fn,
+                        std::size_t range_size = std::size_t{1} << 23,
+                        Fields projection = Fields::All,
+                        Framing framing = Framing::Scan)
+    {
+        auto parse_range = [projection, framing](std::string_view range) {
+            std::vector<Result> results;
+            std::size_t pos = 0;
+            while (auto view = detail::next_record(range, pos, framing)) {
+                results.push_back(web::parse(*view, projection, framing));
+            }
+            return results;
+        };
+        auto ranges = detail::split_records(data, range_size);
+        auto max_in_flight = std::max(threads, std::size_t{1});
+        std::deque<std::future<std::vector<Result>>> in_flight;
+        auto next_range = ranges.begin();
+        while (next_range != ranges.end() or not in_flight.empty()) {
+            while (next_range != ranges.end() and in_flight.size() < max_in_flight) {
+                in_flight.push_back(std::async(std::launch::async, parse_range, *next_range++));
+            }
+            for (auto &result : in_flight.front().get()) {
+                fn(std::move(result));
+            }
+            in_flight.pop_front();
+        }
+    }
+
+    /// Parses records directly from a memory-mapped collection file.
+    ///
+    /// Unlike `TrecParser`, no data is copied: returned records are views
+    /// into the mapping, valid for the lifetime of the parser.
+    class MappedParser {
+       public:
+        /// Only fields in `projection` are extracted, and records end according to `framing`.
+        explicit MappedParser(std::string const &path,
+                              Fields projection = Fields::All,
+                              Framing framing = Framing::Scan)
+            : MappedParser(MappedFile(path), projection, framing)
+        {
+        }
+        explicit MappedParser(MappedFile file,
+                              Fields projection = Fields::All,
+                              Framing framing = Framing::Scan)
+            : file_(std::move(file)), data_(file_.data()), projection_(projection), framing_(framing)
+        {
+        }
+        [[nodiscard]] auto operator()() -> ViewResult { return read_record(); }
+        [[nodiscard]] auto read_record() -> ViewResult
+        {
+            auto view = detail::next_record(data_, pos_, framing_);
+            if (not view) {
+                pos_ = data_.size();
+                return Error{"EOF"};
+            }
+            return web::parse_view(*view, projection_, framing_);
+        }
+        /// Reads the next record into `record`, reusing its memory.
+        /// Returns the error if no record could be read.
+        [[nodiscard]] auto read_record(Record &record) -> std::optional<Error>
+        {
+            auto view = detail::next_record(data_, pos_, framing_);
+            if (not view) {
+                pos_ = data_.size();
+                return Error{"EOF"};
+            }
+            ParseError error;
+            auto parsed = detail::parse_web(*view, error, projection_, framing_);
+            if (not parsed) {
+                return error.to_error();
+            }
+            record.assign(parsed->trecid(), parsed->url(), parsed->content());
+            return std::nullopt;
+        }
+        /// Reads up to `count` records into `batch`, replacing its previous contents
+        /// but reusing its memory. Returns the number of records read.
+        auto read_batch(RecordBatch &batch, std::size_t count) -> std::size_t
+        {
+            batch.clear();
+            while (batch.size() < count) {
+                auto view = detail::next_record(data_, pos_, framing_);
+                if (not view) {
+                    pos_ = data_.size();
+                    break;
+                }
+                auto result = web::parse_view(*view, projection_, framing_);
+                if (auto *record = std::get_if<RecordView>(&result); record != nullptr) {
+                    batch.push_back(*record);
+                } else {
+                    batch.push_back_error(std::get<Error>(std::move(result)));
                 }
-                buf_.resize(old_size + input_.gcount());
-                view = std::string_view(&buf_[0], buf_.size());
-                pos =
-                    view.find(detail::DOC_END,
-                              std::max(old_size, detail::DOC_END.size()) - detail::DOC_END.size());
             }
-            return std::string_view(&buf_[0], pos + detail::DOC_END.size());
+            return batch.size();
+        }
+        /// Reads up to `count` records.
+        [[nodiscard]] auto read_batch(std::size_t count) -> RecordBatch
+        {
+            RecordBatch batch;
+            read_batch(batch, count);
+            return batch;
+        }
+        [[nodiscard]] auto eof() const -> bool
+        {
+            return pos_ == data_.size() || detail::skip_ws(data_, pos_) == data_.size();
         }
 
-        std::istream &input_;
-        std::size_t batch_size_;
-        std::vector<char> buf_{};
+       private:
+        MappedFile file_;
+        std::string_view data_;
+        std::size_t pos_ = 0;
+        Fields projection_;
+        Framing framing_;
     };
 
 } // namespace web
@@ -382,6 +3467,16 @@ std::ostream &operator<<(std::ostream &os, Record const &record)
     return os << "}";
 }
 
+std::ostream &operator<<(std::ostream &os, RecordView const &record)
+{
+    os << "Record {\n";
+    os << "\t" << record.docno_ << "\n";
+    os << "\t" << record.url_ << "\n";
+    return os << "}";
+}
+
+std::ostream &operator<<(std::ostream &os, Error const &error) { return os << error.msg; }
+
 std::ostream &operator<<(std::ostream &os, Result const &result)
 {
     match(result,
@@ -390,4 +3485,12 @@ std::ostream &operator<<(std::ostream &os, Result const &result)
     return os;
 }
 
+std::ostream &operator<<(std::ostream &os, ViewResult const &result)
+{
+    match(result,
+          [&](RecordView const &record) { os << record; },
+          [&](Error const &error) { os << error.msg; });
+    return os;
+}
+
 } // namespace trecpp
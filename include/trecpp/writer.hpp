@@ -0,0 +1,201 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "trecpp.hpp"
+
+namespace trecpp {
+
+/// Output format of `RecordWriter`.
+///
+/// - `Tsv`: one record per line: docno, URL, and content separated by tabs.
+///   Lines of the content are each prefixed with a `\u000A` sequence (so a trailing new line
+///   is dropped), and tabs in the content are replaced by `\u0009`.
+/// - `Jsonl`: one JSON object per line, with `docno`, `url`, and `content` strings.
+///   Bytes are copied as they are, so the output is valid UTF-8 only if the input is.
+/// - `Binary`: docno, URL, and content of each record, each preceded by its length
+///   as a 32-bit little-endian integer, with nothing to unescape.
+enum class Format { Tsv, Jsonl, Binary };
+
+/// Returns the format with the given name: `tsv`, `jsonl`, or `binary`.
+/// Throws `std::invalid_argument` for any other name.
+[[nodiscard]] auto parse_format(std::string_view name) -> Format
+{
+    if (name == "tsv") {
+        return Format::Tsv;
+    }
+    if (name == "jsonl") {
+        return Format::Jsonl;
+    }
+    if (name == "binary") {
+        return Format::Binary;
+    }
+    throw std::invalid_argument("Unknown format: " + std::string(name));
+}
+
+/// Writes records to a stream in one of the `Format`s.
+///
+/// Records are formatted into a buffer, which is written to the stream in blocks
+/// of at least `block_size` bytes. Characters that need escaping are found with
+/// the same vectorized scanner as tags, and the text between them is copied in bulk.
+/// The buffer is flushed when the writer is destroyed.
+class RecordWriter {
+   public:
+    explicit RecordWriter(std::ostream &os,
+                          Format format = Format::Tsv,
+                          std::size_t block_size = std::size_t{1} << 20)
+        : os_(os), format_(format), block_size_(block_size)
+    {
+        buffer_.reserve(block_size_ + block_size_ / 2);
+    }
+    RecordWriter(RecordWriter const &) = delete;
+    RecordWriter &operator=(RecordWriter const &) = delete;
+    RecordWriter(RecordWriter &&) = delete;
+    RecordWriter &operator=(RecordWriter &&) = delete;
+    ~RecordWriter() { flush(); }
+
+    void write(std::string_view docno, std::string_view url, std::string_view content)
+    {
+        switch (format_) {
+        case Format::Tsv:
+            write_tsv(docno, url, content);
+            break;
+        case Format::Jsonl:
+            write_jsonl(docno, url, content);
+            break;
+        case Format::Binary:
+            write_binary(docno);
+            write_binary(url);
+            write_binary(content);
+            break;
+        }
+        if (buffer_.size() >= block_size_) {
+            flush();
+        }
+    }
+    void write(Record const &record) { write(record.trecid(), record.url(), record.content()); }
+    void write(RecordView const &record)
+    {
+        write(record.trecid(), record.url(), record.content());
+    }
+
+    /// Writes out the buffered records.
+    void flush()
+    {
+        os_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+
+   private:
+    void write_tsv(std::string_view docno, std::string_view url, std::string_view content)
+    {
+        buffer_.append(docno);
+        buffer_.push_back('\t');
+        buffer_.append(url);
+        buffer_.push_back('\t');
+        if (not content.empty()) {
+            if (content.back() == '\n') {
+                content.remove_suffix(1);
+            }
+            buffer_.append("\\u000A");
+            append_escaped(content, '\t', '\t', [this](char ch) {
+                switch (ch) {
+                case '\n':
+                    buffer_.append("\\u000A");
+                    break;
+                case '\t':
+                    buffer_.append("\\u0009");
+                    break;
+                default:
+                    buffer_.push_back(ch);
+                }
+            });
+        }
+        buffer_.push_back('\n');
+    }
+
+    void write_jsonl(std::string_view docno, std::string_view url, std::string_view content)
+    {
+        buffer_.append("{\"docno\":");
+        write_json_string(docno);
+        buffer_.append(",\"url\":");
+        write_json_string(url);
+        buffer_.append(",\"content\":");
+        write_json_string(content);
+        buffer_.append("}\n");
+    }
+
+    void write_json_string(std::string_view value)
+    {
+        buffer_.push_back('"');
+        append_escaped(value, '"', '\\', [this](char ch) {
+            switch (ch) {
+            case '"':
+                buffer_.append("\\\"");
+                break;
+            case '\\':
+                buffer_.append("\\\\");
+                break;
+            case '\n':
+                buffer_.append("\\n");
+                break;
+            case '\t':
+                buffer_.append("\\t");
+                break;
+            case '\r':
+                buffer_.append("\\r");
+                break;
+            default:
+                static constexpr std::string_view digits = "0123456789abcdef";
+                buffer_.append("\\u00");
+                buffer_.push_back(digits[static_cast<unsigned char>(ch) >> 4U]);
+                buffer_.push_back(digits[static_cast<unsigned char>(ch) & 0xFU]);
+            }
+        });
+        buffer_.push_back('"');
+    }
+
+    void write_binary(std::string_view value)
+    {
+        if (value.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error("Field too long for binary format");
+        }
+        auto size = static_cast<std::uint32_t>(value.size());
+        std::array<char, 4> prefix{};
+        for (std::size_t idx = 0; idx < prefix.size(); ++idx) {
+            prefix[idx] = static_cast<char>((size >> (8U * idx)) & 0xFFU);
+        }
+        buffer_.append(prefix.data(), prefix.size());
+        buffer_.append(value);
+    }
+
+    /// Appends `value`, calling `escape` for each control character, `a`, or `b`.
+    template <typename Escape>
+    void append_escaped(std::string_view value, char a, char b, Escape &&escape)
+    {
+        auto const &scanner = detail::scan::scanner();
+        std::size_t pos = 0;
+        while (pos < value.size()) {
+            auto next = pos + scanner.find_special(value.data() + pos, value.size() - pos, a, b);
+            buffer_.append(value.data() + pos, next - pos);
+            if (next == value.size()) {
+                break;
+            }
+            escape(value[next]);
+            pos = next + 1;
+        }
+    }
+
+    std::ostream &os_;
+    Format format_;
+    std::size_t block_size_;
+    std::string buffer_;
+};
+
+} // namespace trecpp
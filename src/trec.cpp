@@ -1,87 +1,950 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <glob.h>
 
 #include <CLI/CLI.hpp>
 
+#include <trecpp/compression.hpp>
+#include <trecpp/html.hpp>
+#include <trecpp/index.hpp>
 #include <trecpp/trecpp.hpp>
+#include <trecpp/writer.hpp>
 
 using trecpp::Error;
+using trecpp::Fields;
+using trecpp::web::Framing;
 using trecpp::match;
 using trecpp::Record;
 using trecpp::Result;
+using trecpp::FdSource;
+using trecpp::text::ContentTags;
+
+struct Input {
+    /// Set if the input can be parsed directly from the file descriptor;
+    /// otherwise, it is read from `stream`.
+    std::optional<FdSource> source = std::nullopt;
+    std::istream *stream = nullptr;
+    trecpp::Compression compression = trecpp::Compression::None;
+    std::unique_ptr<trecpp::SourceStreambuf<FdSource>> buf = nullptr;
+    std::unique_ptr<std::istream> file = nullptr;
+    std::unique_ptr<trecpp::PrefetchingIstream> prefetched = nullptr;
+    std::unique_ptr<trecpp::DecompressingIstream> decompressed = nullptr;
+};
 
-template <class RF, class Fn>
-void read(std::istream &is, RF read, Fn &&print_record)
+/// Opens a file (or stdin for `-`), decompressing it if necessary.
+/// Uncompressed input is read directly from the file descriptor, unless `prefetch` is set,
+/// in which case the input is read ahead on a separate thread.
+/// With `direct`, files are read with direct I/O, bypassing the page cache.
+auto open_input(std::string const &path, bool decompress_thread, bool prefetch, bool direct)
+    -> Input
 {
-    while (not is.eof()) {
-        match(
-            read(is),
-            [&](Record const &rec) { print_record(rec); },
-            [&](Error const &error) { std::clog << "Invalid version in line: " << error << '\n'; });
+    Input input;
+    auto source = path == "-" ? FdSource(STDIN_FILENO) : FdSource(path, direct);
+    input.compression = path == "-" ? trecpp::detect_compression(source)
+                                    : trecpp::detect_compression(path);
+    if (input.compression == trecpp::Compression::None and not prefetch) {
+        input.source.emplace(std::move(source));
+        return input;
+    }
+    input.buf = std::make_unique<trecpp::SourceStreambuf<FdSource>>(std::move(source));
+    input.file = std::make_unique<std::istream>(input.buf.get());
+    input.stream = input.file.get();
+    if (prefetch) {
+        input.prefetched = std::make_unique<trecpp::PrefetchingIstream>(*input.stream);
+        input.stream = input.prefetched.get();
     }
+    if (input.compression != trecpp::Compression::None) {
+        input.decompressed = std::make_unique<trecpp::DecompressingIstream>(
+            *input.stream, input.compression, std::size_t{1} << 20, decompress_thread);
+        input.stream = input.decompressed.get();
+    }
+    return input;
 }
 
-auto select_print_fn(std::string const &fmt)
-    -> std::function<std::function<void(Record const &)>(std::ostream &)>
+/// Expands glob patterns and appends paths listed in `file_list` (one per line).
+auto resolve_inputs(std::vector<std::string> const &patterns,
+                    std::optional<std::string> const &file_list) -> std::vector<std::string>
 {
-    auto print_tsv = [](std::ostream &os) {
-        return [&](Record const &rec) {
-            os << rec.trecid() << '\t' << rec.url() << '\t';
-            std::istringstream is(std::move(rec.content()));
-            std::string line;
-            while (std::getline(is, line)) {
-                os << "\\u000A" << line;
-            }
-            os << '\n';
-        };
+    std::vector<std::string> paths;
+    for (auto const &pattern : patterns) {
+        glob_t matches{};
+        if (pattern.find_first_of("*?[") != std::string::npos
+            and ::glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+            paths.insert(paths.end(), matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+        } else {
+            paths.push_back(pattern);
+        }
+        ::globfree(&matches);
+    }
+    if (file_list) {
+        std::ifstream is(*file_list);
+        if (not is) {
+            throw std::runtime_error("Unable to open " + *file_list);
+        }
+        std::string line;
+        while (std::getline(is, line)) {
+            if (not line.empty()) {
+                paths.push_back(line);
+            }
+        }
+    }
+    return paths;
+}
+
+/// Checks if `path` can be an input: stdin, a glob pattern, or an existing file that is
+/// compressed or begins with a tag, unlike any of the output formats.
+auto is_collection(std::string const &path) -> bool
+{
+    if (path == "-" or path.find_first_of("*?[") != std::string::npos) {
+        return true;
+    }
+    std::ifstream is(path, std::ios::binary);
+    if (not is) {
+        return false;
+    }
+    if (trecpp::detect_compression(path) != trecpp::Compression::None) {
+        return true;
+    }
+    char ch = '\0';
+    while (is.get(ch) and trecpp::detail::is_space(static_cast<unsigned char>(ch))) {
+    }
+    return is and ch == '<';
+}
+
+/// Parses a comma-separated list of field names.
+auto parse_fields(std::string const &names) -> Fields
+{
+    auto fields = Fields::Docno;
+    std::istringstream is(names);
+    std::string name;
+    while (std::getline(is, name, ',')) {
+        if (name == "url") {
+            fields = fields | Fields::Url;
+        } else if (name == "content") {
+            fields = fields | Fields::Content;
+        } else if (name != "docno") {
+            throw std::invalid_argument("Unknown field: " + name);
+        }
+    }
+    return fields;
+}
+
+/// Sums up the statistics of all parsers, and prints the sum to `std::cerr` as JSON
+/// every `interval` until destroyed.
+class StatsReporter {
+   public:
+    explicit StatsReporter(std::chrono::seconds interval)
+        : thread_([this, interval] { run(interval); })
+    {
+    }
+    StatsReporter(StatsReporter const &) = delete;
+    StatsReporter &operator=(StatsReporter const &) = delete;
+    StatsReporter(StatsReporter &&) = delete;
+    StatsReporter &operator=(StatsReporter &&) = delete;
+    ~StatsReporter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void add(trecpp::ParseStats const &stats)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        total_.merge(stats);
+    }
+
+    void print()
+    {
+        std::ostringstream json;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            total_.write_json(json);
+        }
+        json << '\n';
+        std::cerr << json.str();
+    }
+
+   private:
+    void run(std::chrono::seconds interval)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (not cv_.wait_for(lock, interval, [&] { return done_; })) {
+            lock.unlock();
+            print();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_ = false;
+    trecpp::ParseStats total_;
+    std::thread thread_;
+};
+
+/// Bounded lock-free queue passing items from one producer thread to one consumer thread.
+///
+/// Items are stored in a ring buffer between two counters, each advanced by one side only.
+/// A side finding the queue full (or empty) spins, then yields, then sleeps, which is cheap
+/// as long as items are large, such as batches of records.
+/// Closing the queue, from either side, ends all waits: `push` then fails,
+/// and `pop` fails once the items pushed before closing have been popped.
+template <typename T>
+class SpscQueue {
+   public:
+    explicit SpscQueue(std::size_t capacity) : slots_(std::max(capacity, std::size_t{1})) {}
+
+    /// Waits for room in the queue, and pushes `item`. Returns `false` if the queue is closed.
+    auto push(T item) -> bool
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        Backoff backoff;
+        while (not closed_.load(std::memory_order_acquire)) {
+            if (tail - head_.load(std::memory_order_acquire) < slots_.size()) {
+                slots_[tail % slots_.size()] = std::move(item);
+                tail_.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+            backoff.wait();
+        }
+        return false;
+    }
+
+    /// Waits for an item, and pops it. Returns `std::nullopt` if the queue is closed and empty.
+    auto pop() -> std::optional<T>
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        Backoff backoff;
+        while (head == tail_.load(std::memory_order_acquire)) {
+            if (closed_.load(std::memory_order_acquire)) {
+                // A producer closes the queue after its last push, which is visible by now.
+                if (head == tail_.load(std::memory_order_acquire)) {
+                    return std::nullopt;
+                }
+                break;
+            }
+            backoff.wait();
+        }
+        std::optional<T> item(std::move(slots_[head % slots_.size()]));
+        head_.store(head + 1, std::memory_order_release);
+        return item;
+    }
+
+    void close() { closed_.store(true, std::memory_order_release); }
+
+   private:
+    class Backoff {
+       public:
+        void wait()
+        {
+            if (++waits_ <= 64) {
+                return;
+            }
+            if (waits_ <= 128) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+
+       private:
+        std::size_t waits_ = 0;
     };
-    return print_tsv;
+
+    std::vector<T> slots_;
+    // On separate cache lines, so that the two sides do not invalidate each other's counter.
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) std::atomic<bool> closed_{false};
+};
+
+/// Source reading another source ahead on a separate thread: the reader stage of the pipeline.
+///
+/// Blocks read from `Source` by a `trecpp::detail::Prefetcher` are handed to the parser,
+/// up to `depth` of them ahead, and their buffers are reused once parsed.
+/// The thread starts with the first `read`, before which the source can still `skip`.
+/// Exceptions thrown by `Source` are rethrown by `read`.
+template <typename Source>
+class ReadAheadSource {
+   public:
+    ReadAheadSource(Source source, std::size_t depth, std::size_t block_size = std::size_t{1} << 20)
+        : source_(std::make_unique<Source>(std::move(source))),
+          depth_(depth),
+          block_size_(block_size)
+    {
+    }
+
+    /// Skips the next `size` bytes with `Source::skip`; only before the first `read`.
+    /// Without `Source::skip`, parsers read and discard the bytes instead.
+    template <typename S = Source,
+              typename = std::enable_if_t<trecpp::detail::has_skip<S>::value>>
+    auto skip(std::size_t size) -> std::size_t
+    {
+        return source_->skip(size);
+    }
+
+    [[nodiscard]] auto read(char *out, std::size_t size) -> std::size_t
+    {
+        if (not prefetcher_) {
+            // One more block is being parsed.
+            prefetcher_ = std::make_unique<trecpp::detail::Prefetcher>(
+                [source = source_.get()](char *block, std::size_t block_size) {
+                    return source->read(block, block_size);
+                },
+                block_size_,
+                depth_ + 1);
+        }
+        while (pos_ == size_) {
+            if (done_) {
+                return 0;
+            }
+            size_ = prefetcher_->next();
+            pos_ = 0;
+            if (size_ == 0) {
+                done_ = true;
+                return 0;
+            }
+        }
+        size = std::min(size, size_ - pos_);
+        std::memcpy(out, prefetcher_->data() + pos_, size);
+        pos_ += size;
+        return size;
+    }
+
+   private:
+    std::unique_ptr<Source> source_;
+    std::size_t depth_;
+    std::size_t block_size_;
+    /// Declared after `source_`, so that its thread stops before the source is destroyed.
+    std::unique_ptr<trecpp::detail::Prefetcher> prefetcher_ = nullptr;
+    std::size_t pos_ = 0;
+    std::size_t size_ = 0;
+    bool done_ = false;
+};
+
+/// Reads batches of records with `parser` on a separate thread, and passes each record
+/// to `print_record(RecordView const &)` and each error to `on_error(Error const &)`
+/// on this one, in input order: the parser and writer stages of the pipeline.
+///
+/// Up to `depth` parsed batches are queued for the writer, and written batches are queued
+/// back to be reused, so whichever stage runs ahead waits for the other.
+/// `on_batch()` is called on the parser thread after each batch.
+template <class Parser, class PrintFn, class ErrorFn, class BatchFn>
+void read_pipelined(Parser &parser,
+                    std::size_t depth,
+                    PrintFn &&print_record,
+                    ErrorFn &&on_error,
+                    BatchFn &&on_batch)
+{
+    constexpr std::size_t batch_records = 256;
+    SpscQueue<std::unique_ptr<trecpp::RecordBatch>> filled(depth);
+    SpscQueue<std::unique_ptr<trecpp::RecordBatch>> free(depth + 2);
+    for (std::size_t idx = 0; idx < depth + 2; ++idx) {
+        free.push(std::make_unique<trecpp::RecordBatch>());
+    }
+    std::exception_ptr error = nullptr;
+    std::thread parse_thread([&] {
+        try {
+            while (auto batch = free.pop()) {
+                parser.read_batch(**batch, batch_records);
+                on_batch();
+                if (((*batch)->empty() and (*batch)->errors().empty())
+                    or not filled.push(std::move(*batch))) {
+                    break;
+                }
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        filled.close();
+    });
+    try {
+        while (auto batch = filled.pop()) {
+            for (auto const &batch_error : (*batch)->errors()) {
+                on_error(batch_error);
+            }
+            for (std::size_t idx = 0; idx < (*batch)->size(); ++idx) {
+                print_record((**batch)[idx]);
+            }
+            free.push(std::move(*batch));
+        }
+    } catch (...) {
+        filled.close();
+        free.close();
+        parse_thread.join();
+        throw;
+    }
+    parse_thread.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/// How input files are parsed.
+struct ParseOptions {
+    bool text = false;
+    Fields fields = Fields::All;
+    Framing framing = Framing::Scan;
+    std::optional<ContentTags> content_tags = std::nullopt;
+    std::optional<std::size_t> max_record_size = std::nullopt;
+    /// Receives parsing statistics, unless null.
+    StatsReporter *stats = nullptr;
+    /// Number of blocks and of record batches queued between the reader, parser,
+    /// and writer threads; 0 to do everything on the calling thread.
+    std::size_t queue_depth = 0;
+    /// Range of bytes in which records begin; see `set_byte_range`.
+    std::size_t byte_offset = 0;
+    std::optional<std::size_t> byte_length = std::nullopt;
+    /// Range of records, counted after the byte range is applied.
+    std::size_t skip = 0;
+    std::optional<std::size_t> limit = std::nullopt;
+};
+
+template <class Parser, class Fn>
+void read(Parser &parser,
+          ParseOptions const &options,
+          Fn &&print_record,
+          std::string const &error_prefix)
+{
+    auto *reporter = options.stats;
+    // Statistics are handed over every so many records, so that progress can be reported.
+    constexpr std::size_t report_every = 4096;
+    trecpp::ParseStats stats;
+    if (options.max_record_size) {
+        parser.set_max_record_size(*options.max_record_size);
+    }
+    if (reporter != nullptr) {
+        parser.set_stats(&stats);
+    }
+    if (options.byte_offset > 0 or options.byte_length) {
+        auto length = options.byte_length.value_or(std::numeric_limits<std::size_t>::max());
+        parser.set_byte_range(options.byte_offset, length);
+    }
+    if (options.skip > 0) {
+        parser.skip(options.skip);
+    }
+    if (options.limit) {
+        parser.set_record_limit(*options.limit);
+    }
+    auto log_error = [&](Error const &error) {
+        std::clog << (error_prefix + "Invalid record: " + error.msg + '\n');
+    };
+    if (options.queue_depth > 0) {
+        read_pipelined(parser, options.queue_depth, print_record, log_error, [&] {
+            if (reporter != nullptr) {
+                reporter->add(stats.take());
+            }
+        });
+    } else {
+        std::size_t count = 0;
+        for (auto const &rec : trecpp::records(parser, log_error)) {
+            print_record(rec);
+            if (reporter != nullptr and ++count % report_every == 0) {
+                reporter->add(stats.take());
+            }
+        }
+    }
+    if (reporter != nullptr) {
+        parser.set_stats(nullptr);
+        reporter->add(stats.take());
+    }
+}
+
+template <class Source, class Fn>
+void parse_source(Source source,
+                  ParseOptions const &options,
+                  Fn &&print_record,
+                  std::string const &error_prefix)
+{
+    if (options.text and options.content_tags) {
+        trecpp::text::BasicTrecParser<ContentTags, Source> parser(
+            std::move(source), 10000, options.fields, *options.content_tags);
+        read(parser, options, print_record, error_prefix);
+    } else if (options.text) {
+        trecpp::text::BasicTrecParser<trecpp::text::DefaultContentTags, Source> parser(
+            std::move(source), 10000, options.fields);
+        read(parser, options, print_record, error_prefix);
+    } else {
+        trecpp::web::BasicTrecParser<Source> parser(
+            std::move(source), 10000, options.fields, options.framing);
+        read(parser, options, print_record, error_prefix);
+    }
+}
+
+/// Parses all records from `source` and prints them, reading, parsing, and printing
+/// on three threads unless `options.queue_depth` is 0.
+template <class Source, class Fn>
+void convert(Source source,
+             ParseOptions const &options,
+             Fn &&print_record,
+             std::string const &error_prefix = "")
+{
+    if (options.queue_depth > 0) {
+        parse_source(ReadAheadSource<Source>(std::move(source), options.queue_depth),
+                     options,
+                     print_record,
+                     error_prefix);
+    } else {
+        parse_source(std::move(source), options, print_record, error_prefix);
+    }
+}
+
+/// Writes the sidecar index of each uncompressed input file.
+void build_indexes(std::vector<std::string> const &paths, bool text, Framing framing)
+{
+    for (auto const &path : paths) {
+        if (path == "-" or trecpp::detect_compression(path) != trecpp::Compression::None) {
+            throw std::runtime_error("Only uncompressed files can be indexed: " + path);
+        }
+        trecpp::MappedFile file(path);
+        trecpp::RecordIndex::build(file.data(), text, framing).save(trecpp::index_path(path));
+    }
+}
+
+/// Looks up `docnos` in the indexed input files, and prints the records that are found.
+/// Returns `false` if any docno could not be found.
+template <class Fn>
+auto fetch(std::vector<std::string> const &paths,
+           std::vector<std::string> const &docnos,
+           bool text,
+           Fields fields,
+           Framing framing,
+           std::optional<ContentTags> const &content_tags,
+           Fn &&print_record) -> bool
+{
+    std::vector<trecpp::IndexedCollection> collections;
+    for (auto const &path : paths) {
+        collections.emplace_back(path);
+    }
+    bool found_all = true;
+    for (auto const &docno : docnos) {
+        auto found = false;
+        for (auto const &collection : collections) {
+            if (auto record = collection.fetch(docno); record) {
+                auto result = not text       ? trecpp::web::parse(*record, fields, framing)
+                              : content_tags ? trecpp::text::parse(*record, fields, *content_tags)
+                                             : trecpp::text::parse(*record, fields);
+                match(
+                    result,
+                    [&](Record const &rec) { print_record(rec); },
+                    [&](Error const &error) {
+                        std::clog << "Invalid record " << docno << ": " << error << '\n';
+                    });
+                found = true;
+                break;
+            }
+        }
+        if (not found) {
+            std::clog << "Record not found: " << docno << '\n';
+            found_all = false;
+        }
+    }
+    return found_all;
+}
+
+/// Prints records to a stream through a shared `RecordWriter`.
+/// If `strip_html` is `true`, the text of the content is printed instead of its HTML.
+/// Output is buffered until the printer (and all its copies) are destroyed.
+class RecordPrinter {
+   public:
+    RecordPrinter(std::ostream &os, trecpp::Format format, bool strip_html)
+        : writer_(std::make_shared<trecpp::RecordWriter>(os, format)),
+          text_(strip_html ? std::make_shared<std::string>() : nullptr)
+    {
+    }
+
+    void operator()(Record const &rec) const { print(rec.trecid(), rec.url(), rec.content()); }
+    void operator()(trecpp::RecordView const &rec) const
+    {
+        print(rec.trecid(), rec.url(), rec.content());
+    }
+
+   private:
+    void print(std::string_view docno, std::string_view url, std::string_view content) const
+    {
+        if (text_ == nullptr) {
+            writer_->write(docno, url, content);
+            return;
+        }
+        text_->clear();
+        trecpp::html::strip(content, *text_);
+        writer_->write(docno, url, *text_);
+    }
+
+    std::shared_ptr<trecpp::RecordWriter> writer_;
+    std::shared_ptr<std::string> text_;
+};
+
+/// Returns a function creating a printer of records to a stream in the format `fmt`.
+auto select_print_fn(std::string const &fmt, bool strip_html)
+    -> std::function<RecordPrinter(std::ostream &)>
+{
+    return [format = trecpp::parse_format(fmt), strip_html](std::ostream &os) {
+        return RecordPrinter(os, format, strip_html);
+    };
+}
+
+/// Converts many files on a pool of `threads` workers.
+///
+/// Each worker takes the next unprocessed file as soon as it is done with the previous one.
+/// Converted files are written to `os` in the input order;
+/// a worker does not start a file more than `2 * threads` files ahead of the output.
+template <class PrintFn>
+void convert_files(std::vector<std::string> const &paths,
+                   std::size_t threads,
+                   PrintFn &&convert_file,
+                   std::ostream &os)
+{
+    std::vector<std::optional<std::string>> outputs(paths.size());
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::size_t next_file = 0;
+    std::size_t next_output = 0;
+    auto max_pending = 2 * threads;
+    auto worker = [&] {
+        while (true) {
+            std::size_t idx;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] {
+                    return next_file == paths.size() or next_file < next_output + max_pending;
+                });
+                if (next_file == paths.size()) {
+                    return;
+                }
+                idx = next_file++;
+            }
+            std::ostringstream buffer;
+            convert_file(paths[idx], buffer);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                outputs[idx] = std::move(buffer).str();
+            }
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (std::size_t idx = 0; idx < threads; ++idx) {
+        workers.emplace_back(worker);
+    }
+    for (std::size_t idx = 0; idx < paths.size(); ++idx) {
+        std::string output;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return outputs[idx].has_value(); });
+            output = std::move(*outputs[idx]);
+            outputs[idx].reset();
+            next_output = idx + 1;
+        }
+        cv.notify_all();
+        os.write(output.data(), output.size());
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
 }
 
 int main(int argc, char **argv)
 {
     bool text = false;
-    std::string input;
+    std::vector<std::string> inputs;
+    std::optional<std::string> file_list = std::nullopt;
     std::optional<std::string> output = std::nullopt;
+    std::optional<std::string> output_dir = std::nullopt;
     std::string fmt = "tsv";
+    std::size_t threads = 1;
+    bool decompress_thread = false;
+    bool prefetch = false;
+    bool direct_io = false;
+    std::string field_names = "docno,url,content";
+    bool build_index = false;
+    std::vector<std::string> fetch_docnos;
+    bool strip_html = false;
+    bool trust_content_length = false;
+    std::optional<std::string> content_tag_names = std::nullopt;
+    std::optional<std::size_t> max_record_size = std::nullopt;
+    bool stats = false;
+    std::size_t stats_interval = 10;
+    std::size_t queue_depth = 4;
+    std::size_t byte_offset = 0;
+    std::optional<std::size_t> byte_length = std::nullopt;
+    std::size_t skip = 0;
+    std::optional<std::size_t> limit = std::nullopt;
     CLI::App app{
-        "Parse a TREC file and output in a selected text format.\n\n"
+        "Parse TREC files and output in a selected text format.\n\n"
         "Because lines delimit records, any new line characters in the content\n"
         "will be replaced by \\u000A sequence."};
-    app.add_option("input", input, "Input file(s); use - to read from stdin")->required();
-    app.add_option("output", output, "Output file; if missing, write to stdout");
-    app.add_option("-f,--format", fmt, "Output file format", true)->check(CLI::IsMember({"tsv"}));
+    app.add_option("input",
+                   inputs,
+                   "Input file(s) or glob patterns; use - to read from stdin; "
+                   "gzip and zstd input is decompressed automatically; "
+                   "a second argument that is not a TREC file is the output file");
+    app.add_option("-l,--file-list", file_list, "File containing input paths, one per line");
+    app.add_option("-o,--output", output, "Output file; if missing, write to stdout");
+    app.add_option("--output-dir",
+                   output_dir,
+                   "Write each input file to a separate file in this directory");
+    app.add_option("-f,--format", fmt, "Output file format", true)
+        ->check(CLI::IsMember({"tsv", "jsonl", "binary"}));
     app.add_flag("--text", text, "Use trectext format rather than trecweb (default)");
+    app.add_option("--fields",
+                   field_names,
+                   "Comma-separated fields to extract (docno, url, content); "
+                   "the others are left empty and are not parsed",
+                   true);
+    app.add_flag("--strip-html",
+                 strip_html,
+                 "Output the text of the content, without HTML markup and with whitespace "
+                 "collapsed");
+    app.add_option("--content-tags",
+                   content_tag_names,
+                   "Comma-separated trectext tags making up the content; by default: "
+                   "TEXT,HEADLINE,TITLE,HL,HEAD,TTL,DD,DATE,LP,LEADPARA");
+    app.add_option("-j,--threads",
+                   threads,
+                   "Number of threads: files are converted in parallel, "
+                   "and a single uncompressed trecweb file is split between threads, "
+                   "unless a range, --max-record-size, --prefetch, --direct-io, or --stats "
+                   "is given",
+                   true);
+    app.add_flag("--decompress-thread",
+                 decompress_thread,
+                 "Decompress compressed input on a separate thread");
+    app.add_flag("--prefetch",
+                 prefetch,
+                 "Read input ahead on a separate thread before decompressing it, "
+                 "overlapping I/O with decompression and parsing; it then takes the place "
+                 "of the reader thread of --queue-depth");
+    app.add_flag("--direct-io",
+                 direct_io,
+                 "Read input files with direct I/O where supported, bypassing the page cache");
+    app.add_option("--queue-depth",
+                   queue_depth,
+                   "Number of input blocks and record batches queued between the threads "
+                   "reading, parsing, and writing each input; 0 to do all on one thread",
+                   true);
+    app.add_flag("--trust-content-length",
+                 trust_content_length,
+                 "Find the end of each trecweb record from its Content-Length header "
+                 "instead of scanning its body, falling back to scanning if it does not match");
+    app.add_option("--max-record-size",
+                   max_record_size,
+                   "Skip and report records larger than this many bytes, "
+                   "bounding the memory used for each input file");
+    app.add_option("--byte-offset",
+                   byte_offset,
+                   "Read only the records beginning at or after this byte of each input, "
+                   "seeking to it in uncompressed files",
+                   true);
+    app.add_option("--byte-length",
+                   byte_length,
+                   "Read only the records beginning within this many bytes from --byte-offset; "
+                   "consecutive ranges split a file without overlap or gaps");
+    app.add_option("--skip", skip, "Skip this many records of each input", true);
+    app.add_option("--limit", limit, "Output at most this many records of each input");
+    app.add_flag("--build-index",
+                 build_index,
+                 "Instead of converting, write a sidecar index <input>.idx for each input file");
+    app.add_option("--fetch",
+                   fetch_docnos,
+                   "Output only the records with these docnos, "
+                   "looked up in the indexes written by --build-index");
+    app.add_flag("--stats",
+                 stats,
+                 "Print parsing statistics to stderr as JSON: periodically, and at the end; "
+                 "a single trecweb file is then not split between threads");
+    app.add_option(
+        "--stats-interval", stats_interval, "Seconds between periodic statistics", true);
     CLI11_PARSE(app, argc, argv);
+    // The former `trec <input> <output>` form is still accepted:
+    // a second positional argument that is not a collection is the output file.
+    if (inputs.size() == 2 and not output and not output_dir and not file_list
+        and not is_collection(inputs.back())) {
+        output = inputs.back();
+        inputs.pop_back();
+    }
+    threads = std::max(threads, std::size_t{1});
+    auto framing = trust_content_length ? Framing::ContentLength : Framing::Scan;
+    std::optional<ContentTags> content_tags = std::nullopt;
+    if (content_tag_names) {
+        content_tags = ContentTags::parse(*content_tag_names);
+    }
+    Fields fields = Fields::All;
+    try {
+        fields = parse_fields(field_names);
+    } catch (std::exception const &error) {
+        std::cerr << error.what() << '\n';
+        return 1;
+    }
+
+    auto print = select_print_fn(fmt, strip_html);
+    std::vector<std::string> paths;
+    try {
+        paths = resolve_inputs(inputs, file_list);
+    } catch (std::exception const &error) {
+        std::cerr << error.what() << '\n';
+        return 1;
+    }
+    if (paths.empty()) {
+        std::cerr << "No input files\n";
+        return 1;
+    }
+
+    if (build_index) {
+        try {
+            build_indexes(paths, text, framing);
+        } catch (std::exception const &error) {
+            std::cerr << error.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
 
-    auto print = select_print_fn(fmt);
+    std::optional<StatsReporter> reporter = std::nullopt;
+    if (stats) {
+        reporter.emplace(std::chrono::seconds(std::max(stats_interval, std::size_t{1})));
+    }
+    ParseOptions options{text,
+                         fields,
+                         framing,
+                         content_tags,
+                         max_record_size,
+                         reporter ? &reporter.value() : nullptr,
+                         // Files converted in parallel already keep all threads busy.
+                         threads > 1 and paths.size() > 1 ? 0 : queue_depth,
+                         byte_offset,
+                         byte_length,
+                         skip,
+                         limit};
+    // Set by any worker when a file cannot be converted, so that the exit status is nonzero.
+    std::atomic<bool> failed{false};
+    auto convert_file = [&](std::string const &path, std::ostream &os) {
+        auto error_prefix = paths.size() > 1 ? path + ": " : std::string{};
+        try {
+            auto input = open_input(path, decompress_thread, prefetch, direct_io);
+            if (input.source) {
+                convert(std::move(*input.source), options, print(os), error_prefix);
+            } else if (input.prefetched) {
+                // Already read ahead, which takes the place of the reader stage.
+                parse_source(
+                    trecpp::IstreamSource(*input.stream), options, print(os), error_prefix);
+            } else {
+                convert(trecpp::IstreamSource(*input.stream), options, print(os), error_prefix);
+            }
+        } catch (std::exception const &error) {
+            std::clog << (error_prefix + error.what() + '\n');
+            failed = true;
+        }
+    };
 
-    std::istream *is = &std::cin;
-    std::unique_ptr<std::ifstream> file_is = nullptr;
-    if (input != "-") {
-        file_is = std::make_unique<std::ifstream>(input);
-        is = file_is.get();
+    if (output_dir) {
+        std::set<std::string> names;
+        for (auto const &path : paths) {
+            if (not names.insert(path.substr(path.find_last_of('/') + 1)).second) {
+                std::cerr << "Duplicate input file name: " << path << '\n';
+                return 1;
+            }
+        }
+        auto convert_to_dir = [&](std::string const &path, std::ostream &) {
+            auto output_path
+                = *output_dir + '/' + path.substr(path.find_last_of('/') + 1) + '.' + fmt;
+            std::ofstream os(output_path);
+            if (not os.is_open()) {
+                std::clog << ("Unable to open " + output_path + '\n');
+                failed = true;
+                return;
+            }
+            convert_file(path, os);
+            os.close();
+            if (not os) {
+                std::clog << ("Unable to write " + output_path + '\n');
+                failed = true;
+            }
+        };
+        std::ostringstream none;
+        convert_files(paths, threads, convert_to_dir, none);
+        if (reporter) {
+            reporter->print();
+        }
+        return failed ? 1 : 0;
     }
 
     std::ostream *os = &std::cout;
     std::unique_ptr<std::ofstream> file_os = nullptr;
     if (output) {
         file_os = std::make_unique<std::ofstream>(*output);
+        if (not file_os->is_open()) {
+            std::cerr << "Unable to open " << *output << '\n';
+            return 1;
+        }
         os = file_os.get();
     }
 
-    if (text) {
-        read(*is, trecpp::text::read_subsequent_record, print(*os));
-    } else {
+    if (not fetch_docnos.empty()) {
+        try {
+            return fetch(paths, fetch_docnos, text, fields, framing, content_tags, print(*os))
+                       ? 0
+                       : 1;
+        } catch (std::exception const &error) {
+            std::cerr << error.what() << '\n';
+            return 1;
+        }
+    } else if (paths.size() > 1) {
+        convert_files(paths, threads, convert_file, *os);
+    } else if (auto const &path = paths.front();
+               threads > 1 and not text and not stats and byte_offset == 0 and not byte_length
+               and skip == 0 and not limit and not max_record_size and not prefetch
+               and not direct_io and path != "-"
+               and trecpp::detect_compression(path) == trecpp::Compression::None) {
+        // The file is mapped in memory and split between threads; options that only
+        // apply to reading the file sequentially are handled by `convert_file` instead.
         auto print_record = print(*os);
-        trecpp::web::TrecParser parser(*is);
-        while (not is->eof()) {
-            match(
-                parser.read_record(),
-                [&](Record const &rec) { print_record(rec); },
-                [&](Error const &error) { std::clog << "Invalid record: " << error << '\n'; });
+        try {
+            trecpp::MappedFile file(path);
+            trecpp::web::parse_parallel(
+                file.data(),
+                threads,
+                [&](Result const &result) {
+                    match(
+                        result,
+                        [&](Record const &rec) { print_record(rec); },
+                        [&](Error const &error) {
+                            std::clog << "Invalid record: " << error << '\n';
+                        });
+                },
+                std::size_t{1} << 23,
+                fields,
+                framing);
+        } catch (std::exception const &error) {
+            std::clog << error.what() << '\n';
+            failed = true;
         }
+    } else {
+        convert_file(path, *os);
+    }
+    if (reporter) {
+        os->flush();
+        reporter->print();
     }
-    return 0;
+    return failed ? 1 : 0;
 }
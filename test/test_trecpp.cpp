@@ -1,9 +1,15 @@
 #define CATCH_CONFIG_MAIN
 #include "catch2/catch.hpp"
 
+#include <filesystem>
+#include <fstream>
 #include <string_view>
 
+#include "trecpp/compression.hpp"
+#include "trecpp/html.hpp"
+#include "trecpp/index.hpp"
 #include "trecpp/trecpp.hpp"
+#include "trecpp/writer.hpp"
 
 using namespace trecpp;
 using namespace trecpp::detail;
@@ -37,6 +43,51 @@ TEST_CASE("read_between") {
     REQUIRE(*body == std::string_view("\n<html>"));
 }
 
+TEST_CASE("Scan for tags and whitespaces", "[unit]")
+{
+    std::vector<scan::Scanner> scanners{{scan::generic::find,
+                                         scan::generic::find_ws,
+                                         scan::generic::find_non_ws,
+                                         scan::generic::find_special,
+                                         scan::generic::find_either},
+                                        scan::scanner()};
+    std::string data;
+    for (int idx = 0; idx < 300; ++idx) {
+        data += std::string(idx % 37, ' ');
+        data += idx % 7 == 0 ? "\t\r\n\v\f" : "";
+        data += idx % 11 == 0 ? "</DOC" : "<D";
+        data += idx % 13 == 0 ? "</DOC>" : "x<y";
+        data += idx % 17 == 0 ? "\"\x80\xff\\" : "";
+    }
+    auto const &tag = detail::DOC_END;
+    for (auto const &scanner : scanners) {
+        for (std::size_t pos = 0; pos < data.size(); ++pos) {
+            auto const *first = data.data() + pos;
+            auto size = data.size() - pos;
+            auto expected_tag = std::string_view(first, size).find(tag);
+            auto found_tag = scanner.find(first, size, tag.data(), tag.size());
+            REQUIRE(found_tag == std::min(expected_tag, size));
+            auto ws = std::find_if(first, first + size, [](unsigned char ch) {
+                return std::isspace(ch);
+            });
+            REQUIRE(scanner.find_ws(first, size) == static_cast<std::size_t>(ws - first));
+            auto non_ws = std::find_if(first, first + size, [](unsigned char ch) {
+                return not std::isspace(ch);
+            });
+            REQUIRE(scanner.find_non_ws(first, size) == static_cast<std::size_t>(non_ws - first));
+            auto special = std::find_if(first, first + size, [](unsigned char ch) {
+                return ch < 0x20 or ch == '"' or ch == '\\';
+            });
+            REQUIRE(scanner.find_special(first, size, '"', '\\')
+                    == static_cast<std::size_t>(special - first));
+            auto either = std::find_if(
+                first, first + size, [](char ch) { return ch == '"' or ch == '\\'; });
+            REQUIRE(scanner.find_either(first, size, '"', '\\')
+                    == static_cast<std::size_t>(either - first));
+        }
+    }
+}
+
 TEST_CASE("parse") {
     std::vector<std::string> data{
         "<DOC>\n"
@@ -187,6 +238,236 @@ TEST_CASE("Read web records", "[unit]")
     REQUIRE(std::get_if<Error>(&rec) != nullptr);
 }
 
+TEST_CASE("Read many small web records with a small batch", "[unit]")
+{
+    std::ostringstream os;
+    for (int idx = 0; idx < 3000; ++idx) {
+        os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+           << "\n</DOCHDR>\n<html>" << std::string(idx % 97, 'x') << "</DOC>\n";
+    }
+    std::istringstream is(os.str());
+    web::TrecParser parser(is, 1);
+    int count = 0;
+    while (not parser.eof()) {
+        auto rec = parser.read_record();
+        Record *record = std::get_if<Record>(&rec);
+        REQUIRE(record != nullptr);
+        REQUIRE(record->trecid() == "GX" + std::to_string(count));
+        REQUIRE(record->url() == "http://a.b/" + std::to_string(count));
+        REQUIRE(record->content() == "\n<html>" + std::string(count % 97, 'x'));
+        ++count;
+    }
+    REQUIRE(count == 3000);
+    auto rec = parser.read_record();
+    REQUIRE(std::get_if<Error>(&rec) != nullptr);
+}
+
+TEST_CASE("Parse web records in parallel", "[unit]")
+{
+    std::ostringstream os;
+    for (int idx = 0; idx < 3000; ++idx) {
+        os << "junk <DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+           << "\n</DOCHDR>\n<html>" << std::string(idx % 97, 'x') << "</DOC>\n";
+        if (idx % 100 == 0) {
+            os << "<DOC><DOCNO>broken</DOCNO></DOC>\n";
+        }
+    }
+    os << "trailing";
+    auto data = os.str();
+    std::vector<std::string> expected;
+    std::istringstream is(data);
+    web::TrecParser parser(is);
+    while (not parser.eof()) {
+        match(
+            parser.read_record(),
+            [&](Record const &rec) { expected.push_back(rec.trecid()); },
+            [&](Error const &error) { expected.push_back(error.msg); });
+    }
+    expected.pop_back(); // trailing data error
+    for (std::size_t range_size : {1, 1000, 1 << 16, 1 << 23}) {
+        std::vector<std::string> actual;
+        web::parse_parallel(
+            data,
+            4,
+            [&](Result const &result) {
+                match(
+                    result,
+                    [&](Record const &rec) { actual.push_back(rec.trecid()); },
+                    [&](Error const &error) { actual.push_back(error.msg); });
+            },
+            range_size);
+        REQUIRE(actual == expected);
+    }
+}
+
+TEST_CASE("Read mapped web records", "[unit]")
+{
+    auto path = std::filesystem::temp_directory_path() / "trecpp_test_mapped.trecweb";
+    {
+        std::ofstream os(path);
+        os << "<DOC>\n"
+              "<DOCNO>GX000-00-0000000</DOCNO>\n"
+              "<DOCHDR>\n"
+              "http://sgra.jpl.nasa.gov\n"
+              "HTTP/1.1 200 OK\n"
+              "</DOCHDR>\n"
+              "<html>"
+              "</DOC>\n        \t"
+              "<DOC>\n"
+              "<DOCNO>GX000-00-0000001</DOCNO>\n"
+              "<DCHDR>\n"
+              "http://sgra.jpl.nasa.gov\n"
+              "</DOCHDR>\n"
+              "<html> 2"
+              "</DOC>\n"
+              "<DOC>\n"
+              "<DOCNO>GX000-00-0000002</DOCNO>\n"
+              "<DOCHDR>\n"
+              "http://sgra.jpl.nasa.gov/2\n"
+              "</DOCHDR>\n"
+              "<html> 2"
+              "</DOC>\n";
+    }
+    web::MappedParser parser(path.string());
+    auto rec = parser.read_record();
+    CAPTURE(rec);
+    RecordView *record = std::get_if<RecordView>(&rec);
+    REQUIRE(record != nullptr);
+    REQUIRE(record->trecid() == "GX000-00-0000000");
+    REQUIRE(record->url() == "http://sgra.jpl.nasa.gov");
+    REQUIRE(record->content() == "\n<html>");
+    REQUIRE_FALSE(parser.eof());
+    rec = parser.read_record();
+    REQUIRE(std::get_if<Error>(&rec) != nullptr);
+    rec = parser.read_record();
+    CAPTURE(rec);
+    record = std::get_if<RecordView>(&rec);
+    REQUIRE(record != nullptr);
+    REQUIRE(record->trecid() == "GX000-00-0000002");
+    REQUIRE(record->url() == "http://sgra.jpl.nasa.gov/2");
+    REQUIRE(record->content() == "\n<html> 2");
+    REQUIRE(parser.eof());
+    rec = parser.read_record();
+    REQUIRE(std::get_if<Error>(&rec) != nullptr);
+    std::filesystem::remove(path);
+}
+
+[[nodiscard]] auto gzip(std::string const &data) -> std::string
+{
+    z_stream zs{};
+    REQUIRE(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8,
+                         Z_DEFAULT_STRATEGY) == Z_OK);
+    std::string out(deflateBound(&zs, data.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef *>(out.data());
+    zs.avail_out = out.size();
+    REQUIRE(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+TEST_CASE("Read compressed web records", "[unit]")
+{
+    std::ostringstream os;
+    for (int idx = 0; idx < 3000; ++idx) {
+        os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+           << "\n</DOCHDR>\n<html>" << std::string(idx % 997, 'x') << "</DOC>\n";
+    }
+    auto data = os.str();
+    auto half = data.find("<DOC>", data.size() / 2);
+    std::vector<std::pair<std::string, std::string>> inputs{
+        {"plain", data},
+        {"gzip", gzip(data)},
+        {"concatenated gzip", gzip(data.substr(0, half)) + gzip(data.substr(half))}};
+#ifdef TRECPP_WITH_ZSTD
+    std::string zstd(ZSTD_compressBound(data.size()), '\0');
+    zstd.resize(ZSTD_compress(zstd.data(), zstd.size(), data.data(), data.size(), 3));
+    inputs.emplace_back("zstd", zstd);
+#endif
+    for (auto const &[name, input] : inputs) {
+        for (bool threaded : {false, true}) {
+            CAPTURE(name, threaded);
+            std::istringstream compressed(input);
+            DecompressingIstream is(compressed, Compression::Auto, 1 << 12, threaded);
+            web::TrecParser parser(is);
+            int count = 0;
+            while (not parser.eof()) {
+                auto rec = parser.read_record();
+                Record *record = std::get_if<Record>(&rec);
+                REQUIRE(record != nullptr);
+                REQUIRE(record->trecid() == "GX" + std::to_string(count));
+                REQUIRE(record->content() == "\n<html>" + std::string(count % 997, 'x'));
+                ++count;
+            }
+            REQUIRE(count == 3000);
+        }
+    }
+    SECTION("Truncated input")
+    {
+        auto truncated = gzip(data);
+        truncated.resize(truncated.size() / 2);
+        std::istringstream compressed(truncated);
+        DecompressingIstream is(compressed, Compression::Gzip);
+        std::string content;
+        REQUIRE_THROWS_AS(content.assign(std::istreambuf_iterator<char>(is), {}),
+                          std::runtime_error);
+    }
+}
+
+TEST_CASE("Read web records with prefetching", "[unit]")
+{
+    std::ostringstream os;
+    for (int idx = 0; idx < 3000; ++idx) {
+        os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+           << "\n</DOCHDR>\n<html>" << std::string(idx % 997, 'x') << "</DOC>\n";
+    }
+    auto data = os.str();
+    for (std::size_t block_size : {1, 1 << 12, 1 << 20}) {
+        CAPTURE(block_size);
+        std::istringstream source(data);
+        PrefetchingIstream is(source, block_size, 2);
+        web::TrecParser parser(is);
+        int count = 0;
+        while (not parser.eof()) {
+            auto rec = parser.read_record();
+            Record *record = std::get_if<Record>(&rec);
+            REQUIRE(record != nullptr);
+            REQUIRE(record->trecid() == "GX" + std::to_string(count));
+            REQUIRE(record->content() == "\n<html>" + std::string(count % 997, 'x'));
+            ++count;
+        }
+        REQUIRE(count == 3000);
+    }
+    SECTION("Character by character")
+    {
+        std::istringstream source(data);
+        PrefetchingIstream is(source, 1000);
+        REQUIRE(std::string(std::istreambuf_iterator<char>(is), {}) == data);
+    }
+    SECTION("Read error")
+    {
+        struct FailingStreambuf : std::streambuf {
+            auto xsgetn(char *, std::streamsize) -> std::streamsize override
+            {
+                throw std::runtime_error("read error");
+            }
+        } failing;
+        std::istream source(&failing);
+        PrefetchingIstream is(source);
+        std::string content;
+        REQUIRE_THROWS_AS(content.assign(std::istreambuf_iterator<char>(is), {}),
+                          std::runtime_error);
+    }
+    SECTION("Destroyed before the end")
+    {
+        std::istringstream source(data);
+        PrefetchingIstream is(source, 16, 1);
+        REQUIRE(is.get() == '<');
+    }
+}
+
 TEST_CASE("Consume tag", "[unit]")
 {
     SECTION("Correct tag")
@@ -347,6 +628,1306 @@ TEST_CASE("Read text record", "[unit]")
     REQUIRE(record->content() == "");
 }
 
+TEST_CASE("Read text records with buffered parser", "[unit]")
+{
+    std::istringstream is(
+        "<DOC>\n"
+        "<DOCNO> b2e89334-33f9-11e1-825f-dabc29fd7071 </DOCNO>\n"
+        "<URL> https://www.washingtonpost.com/stuff </URL>\n"
+        "<TITLE> title \n"
+        "</TITLE>\n"
+        "\n"
+        "\n"
+        "<HEADLINE>\n"
+        " headline \n"
+        "</HEADLINE>\n"
+        "<TEXT> 1 < 2 and other stuff... </TEXT>\n"
+        "</DOC>\n        \t"
+        "<DOC>\n"
+        "<DOCNO> b2e89334-33f9-11e1-825f-dabc29fd7072 </DOCNO>\n"
+        "<IGNORED attr=val>ignored text</IGNORED>\n"
+        "<TTL>not ignored text</TTL>\n"
+        "<TEXT>"
+        "<html> 2"
+        "</TEXT>"
+        "</DOC>\n"
+        "<DOC>\n"
+        "<DOCNO> b2e89334-33f9-11e1-825f-dabc29fd7073 </DOCN>\n"
+        "<TEXT>\n"
+        "<html> 2"
+        "</TEXT>\n"
+        "</DOC>\n"
+        "<DOC>\n"
+        "<DOCNO> b2e89334-33f9-11e1-825f-dabc29fd7071 </DOCNO>\n"
+        "</DOC>");
+    text::TrecParser parser(is);
+    auto rec = parser.read_record();
+    CAPTURE(rec);
+    Record *record = std::get_if<Record>(&rec);
+    REQUIRE(record != nullptr);
+    REQUIRE(record->trecid() == "b2e89334-33f9-11e1-825f-dabc29fd7071");
+    REQUIRE(record->url() == "https://www.washingtonpost.com/stuff");
+    REQUIRE(record->content() ==
+            " title \n"
+            "\n headline \n"
+            " 1 < 2 and other stuff... ");
+    rec = parser.read_record();
+    CAPTURE(rec);
+    record = std::get_if<Record>(&rec);
+    REQUIRE(record != nullptr);
+    REQUIRE(record->trecid() == "b2e89334-33f9-11e1-825f-dabc29fd7072");
+    REQUIRE(record->url() == "");
+    REQUIRE(record->content() ==
+            "not ignored text"
+            "<html> 2");
+    rec = parser.read_record();
+    REQUIRE(std::get_if<Error>(&rec) != nullptr);
+    rec = parser.read_record();
+    record = std::get_if<Record>(&rec);
+    REQUIRE(record != nullptr);
+    REQUIRE(record->trecid() == "b2e89334-33f9-11e1-825f-dabc29fd7071");
+    REQUIRE(record->url() == "");
+    REQUIRE(record->content() == "");
+    REQUIRE(parser.eof());
+}
+
+TEST_CASE("Buffered text parser matches stream parser", "[unit]")
+{
+    std::vector<std::string> elements{"<TEXT>\n some <b>text</b> </TEXT>\n",
+                                      "<HEADLINE> headline </HEADLINE>",
+                                      "<URL> http://x.y/z </URL>\n",
+                                      "<IGNORED a=b>x < y</IGNORED>\n",
+                                      "<TEXT>" + std::string(5000, 't') + "</TEXT>",
+                                      "<TEXT> unclosed </TEX>\n",
+                                      "garbage "};
+    std::ostringstream os;
+    for (std::size_t idx = 0; idx < 2000; ++idx) {
+        os << (idx % 17 == 0 ? "junk\n" : "") << "<DOC>\n<DOCNO> D" << idx
+           << (idx % 23 == 0 ? " </DOCN>\n" : " </DOCNO>\n");
+        for (std::size_t elem = 0; elem < idx % 5; ++elem) {
+            os << elements[(idx * 7 + elem * 3) % (idx % 31 == 0 ? elements.size() : 5)];
+        }
+        os << "</DOC>\n";
+    }
+    auto data = os.str();
+    auto summarize = [](Result const &result) {
+        return match(
+            result,
+            [](Record const &rec) { return rec.trecid() + '|' + rec.url() + '|' + rec.content(); },
+            [](Error const &error) { return error.msg; });
+    };
+    std::vector<std::string> expected;
+    std::istringstream is(data);
+    while (not is.eof()) {
+        expected.push_back(summarize(text::read_subsequent_record(is)));
+    }
+    REQUIRE(expected.back() == "EOF");
+    expected.pop_back();
+    std::vector<std::string> actual;
+    std::istringstream buffered_is(data);
+    text::TrecParser parser(buffered_is);
+    while (not parser.eof()) {
+        actual.push_back(summarize(parser.read_record()));
+    }
+    REQUIRE(actual.size() == expected.size());
+    for (std::size_t idx = 0; idx < actual.size(); ++idx) {
+        CAPTURE(idx);
+        REQUIRE(actual[idx] == expected[idx]);
+    }
+}
+
+TEST_CASE("Read records in batches", "[unit]")
+{
+    std::ostringstream web_os;
+    std::ostringstream text_os;
+    for (int idx = 0; idx < 1000; ++idx) {
+        web_os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+               << "\n</DOCHDR>\n<html>" << std::string(idx % 97, 'x') << "</DOC>\n";
+        text_os << "<DOC>\n<DOCNO> FT" << idx << " </DOCNO>\n<TEXT>"
+                << std::string(idx % 89, 'y') << "</TEXT>\n</DOC>\n";
+        if (idx % 100 == 0) {
+            web_os << "<DOC><DOCNO>broken</DOCNO></DOC>\n";
+            text_os << "<DOC>\n<DOCNO> broken </DOCN>\n</DOC>\n";
+        }
+    }
+    auto summarize = [](auto const &record) {
+        return std::string(record.trecid()) + '|' + std::string(record.url()) + '|'
+               + std::string(record.content());
+    };
+    auto check = [&](auto &&parser, std::vector<std::string> const &expected) {
+        RecordBatch batch;
+        std::vector<std::string> actual;
+        std::size_t errors = 0;
+        while (parser.read_batch(batch, 64) > 0) {
+            REQUIRE(batch.size() <= 64);
+            for (std::size_t idx = 0; idx < batch.size(); ++idx) {
+                REQUIRE(summarize(batch[idx])
+                        == std::string(batch.trecid(idx)) + '|' + std::string(batch.url(idx))
+                               + '|' + std::string(batch.content(idx)));
+                actual.push_back(summarize(batch[idx]));
+            }
+            errors += batch.errors().size();
+        }
+        REQUIRE(parser.eof());
+        REQUIRE(errors == 10);
+        REQUIRE(actual == expected);
+    };
+    auto collect = [&](auto &&parser) {
+        std::vector<std::string> records;
+        while (not parser.eof()) {
+            auto result = parser.read_record();
+            if (auto *record = std::get_if<0>(&result); record != nullptr) {
+                records.push_back(summarize(*record));
+            }
+        }
+        return records;
+    };
+
+    std::istringstream web_is(web_os.str());
+    auto web_expected = collect(web::TrecParser(web_is));
+    REQUIRE(web_expected.size() == 1000);
+    std::istringstream web_batch_is(web_os.str());
+    check(web::TrecParser(web_batch_is, 1), web_expected);
+
+    auto path = std::filesystem::temp_directory_path() / "trecpp_test_batch.trecweb";
+    {
+        std::ofstream os(path);
+        os << web_os.str();
+    }
+    check(web::MappedParser(path.string()), web_expected);
+    std::filesystem::remove(path);
+
+    std::istringstream text_is(text_os.str());
+    auto text_expected = collect(text::TrecParser(text_is));
+    REQUIRE(text_expected.size() == 1000);
+    std::istringstream text_batch_is(text_os.str());
+    check(text::TrecParser(text_batch_is, 1), text_expected);
+
+    std::istringstream is(web_os.str());
+    web::TrecParser parser(is);
+    auto batch = parser.read_batch(10);
+    REQUIRE(batch.size() == 10);
+    REQUIRE(batch.trecid(9) == "GX9");
+    REQUIRE(batch.content_offsets()[0] + batch.content(0).size() == batch.docno_offsets()[1]);
+    batch.clear();
+    REQUIRE(batch.empty());
+    REQUIRE(batch.errors().empty());
+
+    auto web_data = web_os.str();
+    std::istringstream truncated_is(web_data.substr(0, web_data.find("<DOC>\n<DOCNO>GX2"))
+                                    + "<DOC>\n<DOCNO>GX");
+    web::TrecParser truncated(truncated_is);
+    truncated.read_batch(batch, 64);
+    REQUIRE(batch.size() == 2);
+    REQUIRE(batch.errors().size() == 2);
+    REQUIRE(batch.errors()[1].msg.find("Unterminated record") != std::string::npos);
+    REQUIRE(truncated.eof());
+}
+
+TEST_CASE("Parse all records with callbacks", "[unit]")
+{
+    std::ostringstream web_os;
+    std::ostringstream text_os;
+    for (int idx = 0; idx < 1000; ++idx) {
+        web_os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+               << "\n</DOCHDR>\n<html>" << std::string(idx % 97, 'x') << "</DOC>\n";
+        text_os << "<DOC>\n<DOCNO> FT" << idx << " </DOCNO>\n<TEXT>"
+                << std::string(idx % 89, 'y') << "</TEXT>\n</DOC>\n";
+        if (idx % 100 == 0) {
+            web_os << "<DOC><DOCNO>broken</DOCNO></DOC>\n";
+            text_os << "<DOC>\n<DOCNO> broken </DOCN>\n</DOC>\n";
+        }
+    }
+    auto web = web_os.str();
+    auto text = text_os.str();
+    auto expected = [](auto &&parser) {
+        std::vector<std::string> results;
+        while (not parser.eof()) {
+            auto result = parser.read_record();
+            if (auto *record = std::get_if<0>(&result); record != nullptr) {
+                results.push_back(record->trecid() + '|' + record->url() + '|'
+                                  + record->content());
+            } else {
+                results.push_back(std::get<Error>(result).msg);
+            }
+        }
+        return results;
+    };
+    std::vector<std::string> actual;
+    std::string_view data;
+    auto on_record = [&](RecordView const &record) {
+        actual.push_back(std::string(record.trecid()) + '|' + std::string(record.url()) + '|'
+                         + std::string(record.content()));
+    };
+    auto on_error = [&](ParseError const &error) {
+        REQUIRE(data.substr(error.offset, error.context.size()) == error.context);
+        actual.push_back(error.message());
+    };
+
+    std::istringstream web_is(web);
+    auto web_expected = expected(web::TrecParser(web_is));
+    REQUIRE(web_expected.size() == 1010);
+    data = web;
+    std::istringstream web_all_is(web);
+    web::parse_all(web_all_is, on_record, on_error, 1);
+    REQUIRE(actual == web_expected);
+    actual.clear();
+    web::parse_all(data, on_record, on_error);
+    REQUIRE(actual == web_expected);
+
+    std::istringstream text_is(text);
+    auto text_expected = expected(text::TrecParser(text_is));
+    REQUIRE(text_expected.size() == 1010);
+    data = text;
+    actual.clear();
+    std::istringstream text_all_is(text);
+    text::parse_all(text_all_is, on_record, on_error, 1);
+    REQUIRE(actual == text_expected);
+    actual.clear();
+    text::parse_all(data, on_record, on_error);
+    REQUIRE(actual == text_expected);
+
+    std::vector<ParseError> errors;
+    std::istringstream trailing_is("  <DOC><DOCNO>X</DOCNO>\n");
+    web::parse_all(
+        trailing_is, [](RecordView const &) {}, [&](ParseError const &error) {
+            errors.push_back(error);
+        });
+    REQUIRE(errors.size() == 1);
+    REQUIRE(errors[0].code == ErrorCode::UnterminatedRecord);
+    REQUIRE(errors[0].offset == 2);
+}
+
+TEST_CASE("Parse with field projection", "[unit]")
+{
+    std::ostringstream web_os;
+    std::ostringstream text_os;
+    for (int idx = 0; idx < 500; ++idx) {
+        web_os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+               << "\n</DOCHDR>\n<html>" << std::string(idx % 97, 'x') << "</DOC>\n";
+        text_os << "<DOC>\n<DOCNO> FT" << idx << " </DOCNO>\n<URL> http://a.b/" << idx
+                << " </URL>\n<TEXT>" << std::string(idx % 89, 'y') << "</TEXT>\n</DOC>\n";
+    }
+    auto web = web_os.str();
+    auto text = text_os.str();
+    auto summarize = [](Result const &result) {
+        return match(
+            result,
+            [](Record const &rec) { return rec.trecid() + '|' + rec.url() + '|' + rec.content(); },
+            [](Error const &error) { return error.msg; });
+    };
+    auto read_all = [&](auto &&parser) {
+        std::vector<std::string> records;
+        while (not parser.eof()) {
+            records.push_back(summarize(parser.read_record()));
+        }
+        return records;
+    };
+    for (auto projection : {Fields::Docno, Fields::Docno | Fields::Url, Fields::Content}) {
+        CAPTURE(static_cast<int>(projection));
+        auto project = [&](std::vector<std::string> records) {
+            for (auto &record : records) {
+                auto url_begin = record.find('|') + 1;
+                auto content_begin = record.find('|', url_begin) + 1;
+                auto content = has(projection, Fields::Content) ? record.substr(content_begin)
+                                                                : std::string();
+                auto url = has(projection, Fields::Url)
+                               ? record.substr(url_begin, content_begin - url_begin - 1)
+                               : std::string();
+                record = record.substr(0, url_begin) + url + '|' + content;
+            }
+            return records;
+        };
+        std::istringstream web_is(web);
+        std::istringstream projected_web_is(web);
+        REQUIRE(read_all(web::TrecParser(projected_web_is, 10000, projection))
+                == project(read_all(web::TrecParser(web_is))));
+
+        std::istringstream text_is(text);
+        std::istringstream projected_text_is(text);
+        REQUIRE(read_all(text::TrecParser(projected_text_is, 1, projection))
+                == project(read_all(text::TrecParser(text_is))));
+    }
+    REQUIRE(summarize(web::parse("<DOC><DOCNO>X</DOCNO></DOC>", Fields::Docno)) == "X||");
+    REQUIRE(std::holds_alternative<Error>(
+        web::parse("<DOC><DOCNO>X</DOCNO></DOC>", Fields::Docno | Fields::Url)));
+    REQUIRE(summarize(text::parse("<DOC><DOCNO>X</DOCNO><TEXT>a</TEX></DOC>", Fields::Docno))
+            == "X||");
+}
+
+TEST_CASE("Fetch records through a sidecar index", "[unit]")
+{
+    std::ostringstream web_os;
+    std::ostringstream text_os;
+    for (int idx = 999; idx >= 0; --idx) {
+        web_os << "junk <DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+               << "\n</DOCHDR>\n<html>" << std::string(idx % 97, 'x') << "</DOC>\n";
+        text_os << "<DOC>\n<DOCNO> FT" << idx << " </DOCNO>\n<TEXT>"
+                << std::string(idx % 89, 'y') << "</TEXT>\n</DOC>\n";
+        if (idx % 100 == 0) {
+            web_os << "<DOC><DOCNO>broken</DOCNO></DOC>\n";
+            text_os << "<DOC>\n<DOCNO> broken </DOCN>\n</DOC>\n";
+        }
+    }
+    auto dir = std::filesystem::temp_directory_path();
+    for (bool text : {false, true}) {
+        CAPTURE(text);
+        auto path = (dir / (text ? "trecpp_test_index.trec" : "trecpp_test_index.trecweb")).string();
+        auto data = text ? text_os.str() : web_os.str();
+        {
+            std::ofstream os(path);
+            os << data;
+        }
+        std::vector<Record> expected;
+        std::istringstream is(data);
+        auto read_all = [&](auto &&parser) {
+            while (not parser.eof()) {
+                auto result = parser.read_record();
+                if (auto *record = std::get_if<Record>(&result); record != nullptr) {
+                    expected.push_back(*record);
+                }
+            }
+        };
+        if (text) {
+            read_all(text::TrecParser(is));
+        } else {
+            read_all(web::TrecParser(is));
+        }
+        REQUIRE(expected.size() == 1000);
+
+        auto index = RecordIndex::build(data, text);
+        REQUIRE(index.size() == 1000);
+        index.save(index_path(path));
+        IndexedCollection collection(path);
+        REQUIRE(collection.index().size() == 1000);
+        for (std::size_t ordinal = 0; ordinal < expected.size(); ++ordinal) {
+            auto const &record = expected[ordinal];
+            REQUIRE(collection.index().docno(ordinal) == record.trecid());
+            auto fetched = collection.fetch(record.trecid());
+            REQUIRE(fetched);
+            REQUIRE(*fetched == collection.fetch(ordinal));
+            REQUIRE(fetched->substr(0, 5) == "<DOC>");
+            auto result = text ? text::parse(*fetched) : web::parse(*fetched);
+            auto *parsed = std::get_if<Record>(&result);
+            REQUIRE(parsed != nullptr);
+            REQUIRE(parsed->trecid() == record.trecid());
+            REQUIRE(parsed->url() == record.url());
+            REQUIRE(parsed->content() == record.content());
+        }
+        REQUIRE_FALSE(collection.fetch("missing"));
+        REQUIRE_FALSE(collection.fetch("broken"));
+
+        {
+            std::ofstream os(index_path(path), std::ios::binary);
+            os << "TRECIDX1 truncated";
+        }
+        REQUIRE_THROWS_AS(IndexedCollection(path), std::runtime_error);
+        for (std::uint64_t size : {std::uint64_t{1} << 40, ~std::uint64_t{0}}) {
+            CAPTURE(size);
+            std::ostringstream os;
+            os << "TRECIDX1";
+            os.write(reinterpret_cast<char const *>(&size), sizeof(size));
+            os.write(reinterpret_cast<char const *>(&size), sizeof(size));
+            os << std::string(100, '\0');
+            std::istringstream corrupt(os.str());
+            REQUIRE_THROWS_AS(RecordIndex::read(corrupt), std::runtime_error);
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(index_path(path));
+    }
+
+    // The parsers accept a trecweb record without `<DOC>`, and so does the index.
+    std::string web = "<DOCNO>GX0</DOCNO>\n<DOCHDR>\nhttp://a.b\n</DOCHDR>\nx</DOC>\n"
+                      "\n<DOCNO>GX1</DOCNO>\n<DOCHDR>\nhttp://a.b\n</DOCHDR>\ny</DOC>\n";
+    auto index = RecordIndex::build(web, false);
+    REQUIRE(index.size() == 2);
+    REQUIRE(index.location(0).offset == 0);
+    REQUIRE(index.location(1).offset == web.find("<DOCNO>GX1"));
+    REQUIRE(index.location(1).length == web.size() - 1 - web.find("<DOCNO>GX1"));
+
+    // A location whose end overflows is outside of the collection.
+    auto path = (dir / "trecpp_test_index_overflow.trecweb").string();
+    {
+        std::ofstream os(path);
+        os << web;
+    }
+    std::ostringstream os;
+    os << "TRECIDX1";
+    auto write = [&](std::uint64_t value) {
+        os.write(reinterpret_cast<char const *>(&value), sizeof(value));
+    };
+    for (std::uint64_t value : {std::uint64_t{1}, std::uint64_t{1}, ~std::uint64_t{0} - 9,
+                                std::uint64_t{20}, std::uint64_t{0}, std::uint64_t{1},
+                                std::uint64_t{0}}) {
+        write(value);
+    }
+    os << "X";
+    std::istringstream is(os.str());
+    auto overflowing = RecordIndex::read(is);
+    REQUIRE(overflowing.size() == 1);
+    REQUIRE_THROWS_AS(IndexedCollection(path, std::move(overflowing)), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Write records", "[unit]")
+{
+    std::vector<std::string> contents{"",
+                                      "\n",
+                                      "\n\n",
+                                      "abc",
+                                      "\n<html>\nline\n",
+                                      "tab\there\r\n" + std::string(100, 'x') + "\n\nend"};
+    SECTION("TSV")
+    {
+        std::ostringstream os;
+        std::string expected;
+        {
+            RecordWriter writer(os, Format::Tsv, 16);
+            for (auto const &content : contents) {
+                writer.write("D", "http://a.b", content);
+                std::istringstream is(content);
+                expected += "D\thttp://a.b\t";
+                std::string line;
+                while (std::getline(is, line)) {
+                    std::string escaped;
+                    for (char ch : line) {
+                        escaped += ch == '\t' ? std::string("\\u0009") : std::string(1, ch);
+                    }
+                    expected += "\\u000A" + escaped;
+                }
+                expected += '\n';
+            }
+        }
+        REQUIRE(os.str() == expected);
+    }
+    SECTION("JSON lines")
+    {
+        std::ostringstream os;
+        {
+            RecordWriter writer(os, Format::Jsonl);
+            writer.write(RecordView("D\"1", "http://a.b/\\", "a\tb\nc\r\x01\x1f\x80 \"q\""));
+            writer.write(Record("D2", "", ""));
+        }
+        REQUIRE(os.str()
+                == "{\"docno\":\"D\\\"1\",\"url\":\"http://a.b/\\\\\","
+                   "\"content\":\"a\\tb\\nc\\r\\u0001\\u001f\x80 \\\"q\\\"\"}\n"
+                   "{\"docno\":\"D2\",\"url\":\"\",\"content\":\"\"}\n");
+    }
+    SECTION("Binary")
+    {
+        std::ostringstream os;
+        {
+            RecordWriter writer(os, Format::Binary, 1);
+            for (auto const &content : contents) {
+                writer.write("D", "", content);
+            }
+        }
+        auto data = os.str();
+        std::size_t pos = 0;
+        auto read_field = [&] {
+            REQUIRE(pos + 4 <= data.size());
+            std::uint32_t size = 0;
+            for (std::size_t idx = 0; idx < 4; ++idx) {
+                size |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[pos + idx]))
+                        << (8U * idx);
+            }
+            pos += 4;
+            auto field = data.substr(pos, size);
+            pos += size;
+            return field;
+        };
+        for (auto const &content : contents) {
+            REQUIRE(read_field() == "D");
+            REQUIRE(read_field() == "");
+            REQUIRE(read_field() == content);
+        }
+        REQUIRE(pos == data.size());
+    }
+    REQUIRE(parse_format("jsonl") == Format::Jsonl);
+    REQUIRE_THROWS_AS(parse_format("xml"), std::invalid_argument);
+}
+
+TEST_CASE("Extract text and tokens from HTML", "[unit]")
+{
+    std::string_view page =
+        "<!DOCTYPE html>\n<html><head><title>The Title</title>"
+        "<script type=\"text/javascript\">if (a < b) { x = \"</p>\"; }</SCRIPT>"
+        "<style>p { margin: 0; }</style></head>\n"
+        "<body><!-- a <b>comment</b> -->"
+        "<p class=\"x>y\">Caf&eacute; AT&amp;T &lt;tag&gt; 3&#x3C;4&#60;5 na&#239;ve&nbsp;done</p>"
+        "<scripts>kept</scripts>a<b>b</b>c < d &unknown; & ";
+    std::string text;
+    html::extract_text(page, [&](std::string_view piece) { text += piece; });
+    REQUIRE(text
+            == " \n   The Title    \n  "
+               "Caf&eacute; AT&T <tag> 3<4<5 na\xc3\xafve done  kept a b c < d &unknown; & ");
+
+    std::string stripped = "prefix:";
+    html::strip(page, stripped);
+    REQUIRE(stripped
+            == "prefix:The Title Caf&eacute; AT&T <tag> 3<4<5 na\xc3\xafve done kept a b c < d "
+               "&unknown; &");
+
+    std::vector<std::string> tokens;
+    html::tokenize(page, [&](std::string_view token) { tokens.emplace_back(token); });
+    REQUIRE(tokens
+            == std::vector<std::string>{"the", "title", "caf", "eacute", "at", "t", "tag", "3",
+                                        "4", "5", "na\xc3\xafve", "done", "kept", "a", "b",
+                                        "c", "d", "unknown"});
+
+    SECTION("Tokens spanning pieces")
+    {
+        html::Tokenizer tokenizer;
+        std::vector<std::string> fed;
+        auto sink = [&](std::string_view token) { fed.emplace_back(token); };
+        for (std::string_view piece : {"He", "LLo wo", "", "rld", " ", "!x", "Y"}) {
+            tokenizer.feed(piece, sink);
+        }
+        tokenizer.finish(sink);
+        REQUIRE(fed == std::vector<std::string>{"hello", "world", "xy"});
+    }
+    SECTION("Unterminated markup")
+    {
+        std::string rest;
+        html::strip("a<p b=\"c>d", rest);
+        html::strip("e<script>f", rest);
+        html::strip("g<!-- h", rest);
+        REQUIRE(rest == "aeg");
+    }
+    SECTION("Fused with parsing")
+    {
+        std::string_view collection =
+            "<DOC>\n<DOCNO>GX000-00-0000000</DOCNO>\n<DOCHDR>\nhttp://a.gov\n</DOCHDR>\n"
+            "<html><b>Hello</b> World</html>\n</DOC>\n"
+            "<DOC>\n<DOCNO>GX000-00-0000001</DOCNO>\n<DOCHDR>\nhttp://b.gov\n</DOCHDR>\n"
+            "<p>x&amp;y</p>\n</DOC>\n";
+        std::vector<std::string> postings;
+        web::parse_all(
+            collection,
+            [&](RecordView const &record) {
+                html::tokenize(record.content(), [&](std::string_view token) {
+                    postings.push_back(std::string(record.trecid()) + ':' + std::string(token));
+                });
+            },
+            [](ParseError const &) { FAIL(); });
+        REQUIRE(postings
+                == std::vector<std::string>{"GX000-00-0000000:hello",
+                                            "GX000-00-0000000:world",
+                                            "GX000-00-0000001:x",
+                                            "GX000-00-0000001:y"});
+    }
+}
+
+TEST_CASE("Read HTTP headers and trust Content-Length", "[unit]")
+{
+    std::string_view header_record =
+        "<DOC>\n<DOCNO>GX000-00-0000000</DOCNO>\n<DOCHDR>\nhttp://a.gov/\r\n"
+        "HTTP/1.1 404 Not Found\r\nServer: Apache\r\ncontent-type:  text/html; "
+        "Charset=\"UTF-8\" \r\nLast-Modified: Tue, 26 Mar 2002 19:24:25 GMT\r\n"
+        "Content-Length: 5\r\n</DOCHDR>\n<p/>\n</DOC>";
+    auto record = std::get<RecordView>(web::parse_view(header_record));
+    REQUIRE(record.url() == "http://a.gov/");
+    REQUIRE(record.content() == "\n<p/>\n");
+    auto header = record.header();
+    REQUIRE(header.status_line() == "HTTP/1.1 404 Not Found");
+    REQUIRE(header.status_code() == 404);
+    REQUIRE(header.content_type() == "text/html");
+    REQUIRE(header.charset() == "UTF-8");
+    REQUIRE(header.last_modified() == "Tue, 26 Mar 2002 19:24:25 GMT");
+    REQUIRE(header.content_length() == 5U);
+    REQUIRE(header.field("SERVER") == "Apache");
+    REQUIRE(header.field("Server:") == std::nullopt);
+    REQUIRE(HttpHeader("\nServer: x\n").status_code() == std::nullopt);
+    REQUIRE(HttpHeader("Content-Length: 12a\n").content_length() == std::nullopt);
+
+    auto projected = std::get<RecordView>(web::parse_view(header_record, Fields::Header));
+    REQUIRE(projected.url().empty());
+    REQUIRE(projected.content().empty());
+    REQUIRE(projected.header().data() == header.data());
+    REQUIRE(std::get<RecordView>(web::parse_view(header_record, Fields::Url | Fields::Content))
+                .header()
+                .empty());
+
+    auto web_record = [](std::string_view docno, std::size_t length, std::string_view body) {
+        return "<DOC>\n<DOCNO>" + std::string(docno) + "</DOCNO>\n<DOCHDR>\nhttp://a.gov/\n"
+               + "HTTP/1.1 200 OK\nContent-Length: " + std::to_string(length) + "\n</DOCHDR>\n"
+               + std::string(body) + "</DOC>\n";
+    };
+    std::string body_with_tag = "<pre></DOC></pre>\n";
+    std::string collection = web_record("A", 5, "hello") + web_record("B", 0, "")
+                             + web_record("C", body_with_tag.size(), body_with_tag)
+                             + web_record("D", 3, "wrong length") + "\n"
+                             + web_record("E", 1000, "too long") + web_record("F", 2, "ok\n");
+    auto summarize = [&](web::Framing framing) {
+        std::vector<std::string> records;
+        web::parse_all(
+            std::string_view(collection),
+            [&](RecordView const &record) {
+                records.push_back(std::string(record.trecid()) + '|'
+                                  + std::string(record.content()));
+            },
+            [&](ParseError const &error) { records.push_back(error.message()); },
+            Fields::All,
+            framing);
+        return records;
+    };
+    auto scanned = summarize(web::Framing::Scan);
+    auto framed = summarize(web::Framing::ContentLength);
+    REQUIRE(framed
+            == std::vector<std::string>{"A|\nhello",
+                                        "B|\n",
+                                        "C|\n" + body_with_tag,
+                                        "D|\nwrong length",
+                                        "E|\ntoo long",
+                                        "F|\nok\n"});
+    REQUIRE(scanned.size() == framed.size() + 1);
+    REQUIRE(scanned[2] == "C|\n<pre>");
+
+    // Only records split with `Framing::ContentLength` end at their last `</DOC>`.
+    auto two_records = web_record("A", 5, "hello") + web_record("B", 0, "");
+    REQUIRE(std::get<RecordView>(web::parse_view(two_records)).content() == "\nhello");
+    REQUIRE(std::get<RecordView>(web::parse_view(two_records + "\n")).content() == "\nhello");
+    auto unterminated = web_record("A", 5, "hello");
+    unterminated.resize(unterminated.size() - std::string_view("</DOC>\n").size());
+    REQUIRE(std::get<Error>(web::parse_view(unterminated)).msg.find("Unterminated record")
+            != std::string::npos);
+
+    auto stream_summarize = [&](web::Framing framing) {
+        std::istringstream is(collection);
+        web::TrecParser parser(is, 10000, Fields::All, framing);
+        std::vector<std::string> records;
+        while (not parser.eof()) {
+            records.push_back(match(
+                parser.read_record(),
+                [](Record const &rec) { return rec.trecid() + '|' + rec.content(); },
+                [](Error const &error) { return error.msg; }));
+        }
+        return records;
+    };
+    REQUIRE(stream_summarize(web::Framing::Scan) == scanned);
+    REQUIRE(stream_summarize(web::Framing::ContentLength) == framed);
+
+    auto docnos = [](RecordIndex const &index) {
+        std::vector<std::string> docnos;
+        for (std::size_t ordinal = 0; ordinal < index.size(); ++ordinal) {
+            docnos.emplace_back(index.docno(ordinal));
+        }
+        return docnos;
+    };
+    auto index = RecordIndex::build(collection, false, web::Framing::ContentLength);
+    REQUIRE(docnos(index) == std::vector<std::string>{"A", "B", "C", "D", "E", "F"});
+    auto record_c = web_record("C", body_with_tag.size(), body_with_tag);
+    REQUIRE(collection.substr(index.location(2).offset, index.location(2).length)
+            == record_c.substr(0, record_c.size() - 1));
+}
+
+TEST_CASE("Configure content tags", "[unit]")
+{
+    text::DefaultContentTags default_tags;
+    for (auto tag : text::DefaultContentTags::tags) {
+        REQUIRE(default_tags(tag));
+    }
+    for (std::string_view tag : {"", "TEX", "text", "URL", "DOCNO", "GRAPHIC", "HEADLINES"}) {
+        REQUIRE_FALSE(default_tags(tag));
+    }
+    auto tags = text::ContentTags::parse("TEXT,,GRAPHIC");
+    REQUIRE(tags.tags() == std::vector<std::string>{"TEXT", "GRAPHIC"});
+    REQUIRE(tags("TEXT"));
+    REQUIRE(tags("GRAPHIC"));
+    REQUIRE_FALSE(tags("HEADLINE"));
+    REQUIRE_FALSE(tags("TEXTS"));
+    REQUIRE_FALSE(text::ContentTags()("TEXT"));
+
+    std::string record =
+        "<DOC>\n<DOCNO> FT1 </DOCNO>\n<HEADLINE>h</HEADLINE>\n<TEXT>t</TEXT>\n"
+        "<GRAPHIC>g</GRAPHIC>\n</DOC>\n";
+    auto content = [](Result const &result) { return std::get<Record>(result).content(); };
+    REQUIRE(content(text::parse(record)) == "ht");
+    REQUIRE(content(text::parse(record, Fields::All, tags)) == "tg");
+    REQUIRE(content(text::parse(
+                record, Fields::All, [](std::string_view tag) { return tag == "GRAPHIC"; }))
+            == "g");
+
+    std::istringstream is(record + record);
+    text::BasicTrecParser<text::ContentTags> parser(is, 10000, Fields::All, tags);
+    REQUIRE(content(parser.read_record()) == "tg");
+    REQUIRE(content(parser.read_record()) == "tg");
+    REQUIRE(parser.eof());
+
+    std::vector<std::string> contents;
+    text::parse_all(
+        std::string_view(record),
+        [&](RecordView const &view) { contents.emplace_back(view.content()); },
+        [](ParseError const &) { FAIL(); },
+        Fields::All,
+        tags);
+    std::istringstream all_is(record);
+    text::parse_all(
+        all_is,
+        [&](RecordView const &view) { contents.emplace_back(view.content()); },
+        [](ParseError const &) { FAIL(); },
+        10000,
+        Fields::All,
+        tags);
+    REQUIRE(contents == std::vector<std::string>{"tg", "tg"});
+}
+
+TEST_CASE("Iterate over records", "[unit]")
+{
+    using iterator = RecordRange<web::TrecParser>::iterator;
+    static_assert(std::is_same_v<std::iterator_traits<iterator>::iterator_category,
+                                 std::input_iterator_tag>);
+    static_assert(std::is_same_v<std::iterator_traits<iterator>::reference, Record const &>);
+
+    std::ostringstream web_os;
+    std::ostringstream text_os;
+    for (int idx = 0; idx < 200; ++idx) {
+        // Records get smaller, so their content fits in the memory of the previous one.
+        auto size = static_cast<std::size_t>(400 - idx);
+        web_os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+               << "\n</DOCHDR>\n" << std::string(size, 'x') << "</DOC>\n";
+        text_os << "<DOC>\n<DOCNO> FT" << idx << " </DOCNO>\n<TEXT>" << std::string(size, 'y')
+                << "</TEXT>\n</DOC>\n";
+        if (idx % 50 == 0) {
+            web_os << "<DOC>\n<DOCNO>BROKEN</DOCNO>\n</DOC>\n";
+            text_os << "<DOC>\n<DOCNO> BROKEN </DOCN>\n</DOC>\n";
+        }
+    }
+    web_os << "trailing";
+    auto summarize = [](Record const &record) {
+        return record.trecid() + '|' + record.url() + '|' + std::to_string(record.content().size());
+    };
+    auto read_all = [&](auto &&parser) {
+        std::vector<std::string> records;
+        std::size_t errors = 0;
+        while (not parser.eof()) {
+            match(
+                parser.read_record(),
+                [&](Record const &record) { records.push_back(summarize(record)); },
+                [&](Error const &) { ++errors; });
+        }
+        return std::make_pair(records, errors);
+    };
+    auto iterate = [&](auto &&range, std::size_t &errors) {
+        std::vector<std::string> records;
+        char const *content = nullptr;
+        for (auto it = range.begin(); it != range.end(); ++it) {
+            records.push_back(summarize(*it));
+            if (content != nullptr) {
+                REQUIRE(it->content().data() == content);
+            }
+            content = it->content().data();
+        }
+        return std::make_pair(records, errors);
+    };
+
+    std::size_t web_errors = 0;
+    std::istringstream web_is(web_os.str());
+    std::istringstream web_range_is(web_os.str());
+    auto web_expected = read_all(web::TrecParser(web_is));
+    REQUIRE(web_expected.first.size() == 200);
+    REQUIRE(iterate(web::records(web_range_is, [&](Error const &) { ++web_errors; }), web_errors)
+            == web_expected);
+
+    std::size_t text_errors = 0;
+    std::istringstream text_is(text_os.str());
+    std::istringstream text_range_is(text_os.str());
+    auto text_expected = read_all(text::TrecParser(text_is));
+    REQUIRE(text_expected.first.size() == 200);
+    REQUIRE(
+        iterate(text::records(text_range_is, [&](Error const &) { ++text_errors; }), text_errors)
+        == text_expected);
+
+    std::istringstream is(web_os.str());
+    web::TrecParser parser(is, 10000, Fields::Docno);
+    std::size_t count = 0;
+    for (auto const &record : records(parser)) {
+        REQUIRE(record.url().empty());
+        ++count;
+    }
+    REQUIRE(count == 204);
+    REQUIRE(parser.eof());
+}
+
+TEST_CASE("Collect parse statistics", "[unit]")
+{
+    std::string web_record = "<DOC>\n<DOCNO>GX0</DOCNO>\n<DOCHDR>\nhttp://a.b\n</DOCHDR>\n"
+                             + std::string(200000, 'x') + "</DOC>\n";
+    std::string web = "<DOC>\n<DOCNO>GX1</DOCNO>\n<html></DOC>\n" + web_record + web_record
+                      + "<DOC>\n<DOCNO>GX2</DOCNO>";
+    std::istringstream web_is(web);
+    web::TrecParser web_parser(web_is);
+    ParseStats stats;
+    web_parser.set_stats(&stats);
+    std::size_t record_count = 0;
+    std::size_t errors = 0;
+    web_parser.parse_all([&](RecordView const &) { ++record_count; },
+                         [&](ParseError const &) { ++errors; });
+    REQUIRE(record_count == 2);
+    REQUIRE(errors == 2);
+    REQUIRE(stats.records == 2);
+    REQUIRE(stats.error_count() == 2);
+    REQUIRE(stats.errors[static_cast<std::size_t>(ErrorCode::MissingDochdr)] == 1);
+    REQUIRE(stats.errors[static_cast<std::size_t>(ErrorCode::UnterminatedRecord)] == 1);
+    REQUIRE(stats.bytes_read == web.size());
+    REQUIRE(stats.largest_record == web_record.size());
+    REQUIRE(stats.buffer_growths > 0);
+    REQUIRE(stats.time_in(ParseStats::Phase::Io).count() > 0);
+    REQUIRE(stats.time_in(ParseStats::Phase::Scan).count() > 0);
+
+    std::string text = "<DOC>\n<DOCNO> FT1 </DOCNO>\n<TEXT>a</TEXT>\n</DOC>\n"
+                       "<DOC>\n<DOCNO> FT2 </DOCN>\n</DOC>\n"
+                       "<DOC>\n<DOCNO> FT3 </DOCNO>\n<TEXT>bc</TEXT>\n</DOC>\n";
+    std::istringstream text_is(text);
+    text::TrecParser text_parser(text_is);
+    ParseStats text_stats;
+    text_parser.set_stats(&text_stats);
+    std::vector<std::string> docnos;
+    for (auto const &record : records(text_parser)) {
+        docnos.push_back(record.trecid());
+    }
+    REQUIRE(docnos == std::vector<std::string>{"FT1", "FT3"});
+    REQUIRE(text_stats.records == 2);
+    REQUIRE(text_stats.errors[static_cast<std::size_t>(ErrorCode::MissingDocnoEnd)] == 1);
+    REQUIRE(text_stats.bytes_read == text.size());
+    REQUIRE(text_stats.largest_record == 49);
+    REQUIRE(text_stats.buffer_growths == 0);
+    REQUIRE(text_stats.time_in(ParseStats::Phase::Copy).count() > 0);
+
+    auto taken = text_stats.take();
+    REQUIRE(taken.records == 2);
+    REQUIRE(text_stats.records == 0);
+    stats.merge(taken);
+    REQUIRE(stats.records == 4);
+    REQUIRE(stats.error_count() == 3);
+    REQUIRE(stats.largest_record == web_record.size());
+
+    std::ostringstream json;
+    stats.write_json(json);
+    auto prefix = "{\"bytes_read\":" + std::to_string(web.size() + text.size())
+                  + ",\"records\":4,\"errors\":3,\"errors_by_code\":{\"missing_doc\":0,"
+                    "\"missing_docno\":0,\"missing_docno_end\":1,\"missing_dochdr\":1,";
+    REQUIRE(json.str().substr(0, prefix.size()) == prefix);
+    REQUIRE(json.str().find(",\"seconds\":{\"io\":") != std::string::npos);
+    REQUIRE(json.str().back() == '}');
+}
+
+TEST_CASE("Recover from errors in long lines", "[unit]")
+{
+    // Broken records on a single line, as in minified HTML.
+    std::string line;
+    for (std::size_t idx = 0; idx < 200; ++idx) {
+        line += "<DOC><DOCNO> B" + std::to_string(idx) + " </DOCN> <p>" + std::string(1000, 'x')
+                + "</p> <DO <<DOCNO> </DOC>";
+    }
+    auto data = line + "\n<DOC>\n<DOCNO> A </DOCNO>\n<TEXT> a </TEXT>\n</DOC>\n";
+
+    std::vector<std::string> expected;
+    std::istringstream is(data);
+    while (not is.eof()) {
+        auto result = text::read_subsequent_record(is);
+        if (auto *error = std::get_if<Error>(&result); error != nullptr) {
+            expected.push_back(error->msg);
+        } else {
+            expected.push_back(std::get<Record>(result).trecid());
+        }
+    }
+    REQUIRE(expected.size() == 202);
+    REQUIRE(expected[200] == "A");
+    REQUIRE(expected[201] == "EOF");
+    auto prefix = std::string("Could not consume </DOCNO> in context: ");
+    REQUIRE(expected[0].substr(0, prefix.size()) == prefix);
+    REQUIRE(expected[0].size() == prefix.size() + detail::ERROR_CONTEXT_SIZE);
+
+    std::istringstream buffered_is(data);
+    text::TrecParser parser(buffered_is);
+    for (std::size_t idx = 0; idx < 201; ++idx) {
+        auto result = parser.read_record();
+        if (auto *error = std::get_if<Error>(&result); error != nullptr) {
+            REQUIRE(error->msg == expected[idx]);
+        } else {
+            REQUIRE(std::get<Record>(result).trecid() == expected[idx]);
+        }
+    }
+    REQUIRE(parser.eof());
+
+    text::parse_all(
+        data,
+        [](RecordView const &) {},
+        [](ParseError const &error) {
+            REQUIRE(error.context.size() <= detail::ERROR_CONTEXT_SIZE);
+        });
+}
+
+TEST_CASE("Skip records over the maximum size", "[unit]")
+{
+    auto web_record = [](std::string const &docno, std::size_t size) {
+        return "<DOC>\n<DOCNO>" + docno + "</DOCNO>\n<DOCHDR>\nhttp://a.b\n</DOCHDR>\n"
+               + std::string(size, 'x') + "</DOC>\n";
+    };
+    // The second record is too large, and the fourth is missing its `</DOC>`.
+    std::string web = web_record("GX1", 100) + web_record("GX2", 100000) + web_record("GX3", 3000)
+                      + "<DOC>\n<DOCNO>GX4</DOCNO>\n" + std::string(100000, 'y')
+                      + web_record("GX5", 100);
+    for (auto framing : {web::Framing::Scan, web::Framing::ContentLength}) {
+        std::istringstream is(web);
+        web::TrecParser parser(is, 1024, Fields::All, framing);
+        parser.set_max_record_size(4096);
+        ParseStats stats;
+        parser.set_stats(&stats);
+        std::vector<std::string> docnos;
+        std::vector<std::size_t> offsets;
+        parser.parse_all(
+            [&](RecordView const &record) { docnos.emplace_back(record.trecid()); },
+            [&](ParseError const &error) {
+                REQUIRE(error.code == ErrorCode::OversizeRecord);
+                REQUIRE(error.message().substr(0, 27) == "Oversize record in context:");
+                offsets.push_back(error.offset);
+            });
+        REQUIRE(docnos == std::vector<std::string>{"GX1", "GX3", "GX5"});
+        auto gx4 = web.find("<DOC>\n<DOCNO>GX4");
+        REQUIRE(offsets == std::vector<std::size_t>{web.find("<DOC>\n<DOCNO>GX2"), gx4});
+        REQUIRE(stats.errors[static_cast<std::size_t>(ErrorCode::OversizeRecord)] == 2);
+        REQUIRE(stats.buffer_growths <= 2);
+    }
+    {
+        std::istringstream is(web);
+        web::TrecParser parser(is, 1024);
+        parser.set_max_record_size(4096);
+        std::vector<std::string> results;
+        for (auto const &record :
+             records(parser, [&](Error const &error) { results.push_back(error.msg); })) {
+            results.push_back(record.trecid());
+        }
+        REQUIRE(results.size() == 5);
+        REQUIRE(results[2] == "GX3");
+        REQUIRE(results[4] == "GX5");
+    }
+
+    std::string text = "<DOC>\n<DOCNO> FT1 </DOCNO>\n<TEXT>" + std::string(100000, 'x')
+                       + "</TEXT>\n</DOC>\n<DOC>\n<DOCNO> FT2 </DOCNO>\n<TEXT>"
+                       + std::string(100000, 'y')
+                       + "\n<DOC>\n<DOCNO> FT3 </DOCNO>\n<TEXT>z</TEXT>\n</DOC>\n";
+    std::istringstream is(text);
+    text::TrecParser parser(is, 1024);
+    parser.set_max_record_size(4096);
+    auto batch = parser.read_batch(10);
+    REQUIRE(batch.size() == 1);
+    REQUIRE(batch.errors().size() == 2);
+    REQUIRE(batch.trecid(0) == "FT3");
+    REQUIRE(parser.eof());
+}
+
+TEST_CASE("Skip records over the maximum size when read as a whole", "[unit]")
+{
+    // Every record fits in a single read, and so does the input; the cap is smaller.
+    auto web_record = [](std::size_t idx, std::size_t size) {
+        auto body = std::string(size, 'x');
+        return "<DOC>\n<DOCNO>W" + std::to_string(idx)
+               + "</DOCNO>\n<DOCHDR>\nhttp://a.b\nContent-Length: " + std::to_string(size)
+               + "\n</DOCHDR>\n" + body + "</DOC>\n";
+    };
+    auto text_record = [](std::size_t idx, std::size_t size) {
+        return "<DOC>\n<DOCNO> T" + std::to_string(idx) + " </DOCNO>\n<TEXT>"
+               + std::string(size, 'x') + "</TEXT>\n</DOC>\n";
+    };
+    std::vector<std::size_t> sizes{500, 3000, 500, 3000};
+    std::string web;
+    std::string text;
+    std::vector<std::size_t> web_offsets;
+    std::vector<std::size_t> text_offsets;
+    for (std::size_t idx = 0; idx < sizes.size(); ++idx) {
+        if (sizes[idx] > 1000) {
+            web_offsets.push_back(web.size());
+            text_offsets.push_back(text.size());
+        }
+        web += web_record(idx, sizes[idx]);
+        text += text_record(idx, sizes[idx]);
+    }
+    auto collect = [](auto &parser, std::vector<std::size_t> &offsets) {
+        std::vector<std::string> docnos;
+        parser.set_max_record_size(1000);
+        parser.parse_all(
+            [&](RecordView const &record) { docnos.emplace_back(record.trecid()); },
+            [&](ParseError const &error) {
+                REQUIRE(error.code == ErrorCode::OversizeRecord);
+                offsets.push_back(error.offset);
+            });
+        return docnos;
+    };
+    for (auto framing : {web::Framing::Scan, web::Framing::ContentLength}) {
+        std::istringstream is(web);
+        web::TrecParser parser(is, 1 << 16, Fields::All, framing);
+        std::vector<std::size_t> offsets;
+        REQUIRE(collect(parser, offsets) == std::vector<std::string>{"W0", "W2"});
+        REQUIRE(offsets == web_offsets);
+    }
+    {
+        std::istringstream is(text);
+        text::TrecParser parser(is, 1 << 16);
+        std::vector<std::size_t> offsets;
+        REQUIRE(collect(parser, offsets) == std::vector<std::string>{"T0", "T2"});
+        REQUIRE(offsets == text_offsets);
+    }
+
+    // The input ends with an oversize record, which is not followed by an error for EOF.
+    auto read_all = [](auto parser) {
+        parser.set_max_record_size(1000);
+        std::vector<std::string> results;
+        for (auto const &record :
+             records(parser, [&](Error const &error) { results.push_back(error.msg); })) {
+            results.push_back(record.trecid());
+        }
+        return results;
+    };
+    for (std::size_t batch_size : {std::size_t{1024}, std::size_t{1} << 16}) {
+        CAPTURE(batch_size);
+        std::istringstream web_is(web);
+        auto web_results = read_all(web::TrecParser(web_is, batch_size));
+        REQUIRE(web_results.size() == 4);
+        REQUIRE(web_results[2] == "W2");
+        REQUIRE(web_results[3].substr(0, 15) == "Oversize record");
+        std::istringstream text_is(text);
+        auto text_results = read_all(text::TrecParser(text_is, batch_size));
+        REQUIRE(text_results.size() == 4);
+        REQUIRE(text_results[2] == "T2");
+        REQUIRE(text_results[3].substr(0, 15) == "Oversize record");
+    }
+}
+
+TEST_CASE("Stream content in chunks", "[unit]")
+{
+    auto web_record = [](std::string const &docno, std::string const &body) {
+        return "<DOC>\n<DOCNO>" + docno + "</DOCNO>\n<DOCHDR>\nhttp://a.b/" + docno
+               + "\nHTTP/1.1 200 OK\nContent-Type: text/html\n</DOCHDR>\n" + body
+               + "</DOC>\n";
+    };
+    std::string large;
+    for (std::size_t idx = 0; large.size() < 1000000; ++idx) {
+        large += "<p>" + std::to_string(idx) + "</DO</p>\n";
+    }
+    auto unterminated = web_record("GX5", "end");
+    unterminated.resize(unterminated.size() - 7);
+    std::string web = web_record("GX1", "small") + web_record("GX2", large)
+                      + "<DOC>\n<DOCNO>GX3</DOCNO>\n</DOC>\n" + web_record("GX4", "")
+                      + unterminated;
+
+    std::vector<std::string> expected;
+    std::istringstream expected_is(web);
+    web::TrecParser expected_parser(expected_is);
+    while (not expected_parser.eof()) {
+        auto result = expected_parser.read_record();
+        if (auto *record = std::get_if<Record>(&result); record != nullptr) {
+            expected.push_back(record->trecid() + '|' + record->url() + '|' + record->content());
+        } else {
+            expected.push_back(std::get<Error>(result).msg);
+        }
+    }
+    REQUIRE(expected.size() == 5);
+
+    std::istringstream is(web);
+    web::TrecParser parser(is, 1024);
+    parser.set_max_record_size(4096);
+    ParseStats stats;
+    parser.set_stats(&stats);
+    std::vector<std::string> actual;
+    std::size_t chunks = 0;
+    std::size_t largest_chunk = 0;
+    while (not parser.eof()) {
+        std::string summary;
+        auto error = parser.stream_record(
+            [&](RecordView const &head) {
+                REQUIRE(head.content().empty());
+                REQUIRE(head.header().content_type() == "text/html");
+                summary = std::string(head.trecid()) + '|' + std::string(head.url()) + '|';
+            },
+            [&](std::string_view chunk) {
+                ++chunks;
+                largest_chunk = std::max(largest_chunk, chunk.size());
+                summary += chunk;
+            });
+        actual.push_back(error ? error->msg : summary);
+    }
+    // `read_record` cannot tell an unterminated record from the end of the input.
+    REQUIRE(expected[4] == "EOF");
+    REQUIRE(actual.size() == 5);
+    REQUIRE(actual[4] == "Unterminated record in context: <DOCNO>GX5</DOCNO>");
+    actual.pop_back();
+    expected.pop_back();
+    REQUIRE(actual == expected);
+    // The buffer is filled in chunks of 64 KiB, and never grows beyond two of them.
+    REQUIRE(chunks > 10);
+    REQUIRE(largest_chunk <= (std::size_t{1} << 17));
+    REQUIRE(stats.records == 3);
+    REQUIRE(stats.largest_record > 1000000);
+    REQUIRE(stats.errors[static_cast<std::size_t>(ErrorCode::MissingDochdr)] == 1);
+    REQUIRE(stats.errors[static_cast<std::size_t>(ErrorCode::UnterminatedRecord)] == 1);
+}
+
+TEST_CASE("Read from sources", "[unit]")
+{
+    std::ostringstream os;
+    for (std::size_t idx = 0; idx < 3000; ++idx) {
+        os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+           << "\n</DOCHDR>\n" << std::string(idx % 500, 'x') << "</DOC>\n";
+    }
+    auto data = os.str();
+    auto summarize = [](auto &&parser) {
+        std::vector<std::string> results;
+        for (auto const &record : records(parser)) {
+            results.push_back(record.trecid() + '|' + record.url() + '|' + record.content());
+        }
+        return results;
+    };
+    std::istringstream is(data);
+    web::TrecParser parser(is);
+    auto expected = summarize(parser);
+    REQUIRE(expected.size() == 3000);
+
+    web::BasicTrecParser<ViewSource> view_parser(ViewSource{data});
+    REQUIRE(summarize(view_parser) == expected);
+
+    auto path = std::filesystem::temp_directory_path() / "trecpp_test_source.trecweb";
+    {
+        std::ofstream file(path);
+        file << data;
+    }
+    for (bool direct : {false, true}) {
+        FdSource source(path.string(), direct);
+        REQUIRE(source.peek(5) == "<DOC>");
+        REQUIRE(source.peek(2) == "<DOC>");
+        web::BasicTrecParser<FdSource> fd_parser(std::move(source), 1000);
+        REQUIRE(summarize(fd_parser) == expected);
+    }
+    REQUIRE_THROWS_AS(FdSource((path / "missing").string()), std::system_error);
+    std::filesystem::remove(path);
+
+    std::string text = "junk <DOC>\n<DOCNO> FT1 </DOCNO>\n<TEXT>a</TEXT>\n</DOC>\n";
+    text::BasicTrecParser<text::DefaultContentTags, ViewSource> text_parser(ViewSource{text});
+    auto record = std::get<Record>(text_parser.read_record());
+    REQUIRE(record.trecid() == "FT1");
+    REQUIRE(record.content() == "a");
+
+    // Sources can also be read as streams, with buffered or bulk reads.
+    SourceStreambuf<ViewSource> buf(ViewSource{text}, 16);
+    std::istream text_is(&buf);
+    auto result = text::read_subsequent_record(text_is);
+    REQUIRE(std::get<Record>(result).trecid() == "FT1");
+    SourceStreambuf<ViewSource> bulk_buf(ViewSource{data}, 16);
+    std::istream bulk_is(&bulk_buf);
+    web::TrecParser bulk_parser(bulk_is);
+    REQUIRE(summarize(bulk_parser) == expected);
+}
+
+TEST_CASE("Select byte and record ranges", "[unit]")
+{
+    std::ostringstream web_os;
+    std::ostringstream text_os;
+    for (std::size_t idx = 0; idx < 300; ++idx) {
+        web_os << "<DOC>\n<DOCNO>GX" << idx << "</DOCNO>\n<DOCHDR>\nhttp://a.b/" << idx
+               << "\n</DOCHDR>\n" << std::string(idx * 7 % 500, 'x') << "</DOC>\n";
+        text_os << "<DOC>\n<DOCNO> FT" << idx << " </DOCNO>\n<TEXT>"
+                << std::string(idx * 5 % 300, 'y') << "</TEXT>\n</DOC>\n";
+    }
+    auto web_data = web_os.str();
+    auto text_data = text_os.str();
+    auto summarize = [](auto &&parser, std::vector<std::string> &results) {
+        for (auto const &record : records(parser)) {
+            results.push_back(record.trecid() + '|' + record.content());
+        }
+    };
+    std::vector<std::string> web_expected;
+    std::vector<std::string> text_expected;
+    summarize(web::BasicTrecParser<ViewSource>(ViewSource{web_data}), web_expected);
+    summarize(text::BasicTrecParser<text::DefaultContentTags, ViewSource>(ViewSource{text_data}),
+              text_expected);
+    REQUIRE(web_expected.size() == 300);
+    REQUIRE(text_expected.size() == 300);
+
+    // Consecutive ranges produce all records once, whatever the sources skip with.
+    struct ReadOnlySource {
+        ViewSource source;
+        auto read(char *out, std::size_t size) -> std::size_t { return source.read(out, size); }
+    };
+    auto split = [&](auto make_parser, std::size_t size, std::size_t length) {
+        std::vector<std::string> results;
+        for (std::size_t offset = 0; offset < size; offset += length) {
+            auto parser = make_parser();
+            parser.set_byte_range(offset, length);
+            summarize(parser, results);
+        }
+        return results;
+    };
+    for (std::size_t length : {13, 211, 4096}) {
+        CAPTURE(length);
+        REQUIRE(split([&] { return web::BasicTrecParser<ViewSource>(ViewSource{web_data}, 64); },
+                      web_data.size(),
+                      length)
+                == web_expected);
+        REQUIRE(split(
+                    [&] {
+                        return web::BasicTrecParser<ReadOnlySource>(
+                            ReadOnlySource{ViewSource{web_data}}, 64);
+                    },
+                    web_data.size(),
+                    length)
+                == web_expected);
+        REQUIRE(split(
+                    [&] {
+                        return text::BasicTrecParser<text::DefaultContentTags, ViewSource>(
+                            ViewSource{text_data}, 64);
+                    },
+                    text_data.size(),
+                    length)
+                == text_expected);
+    }
+    std::istringstream is(web_data);
+    web::TrecParser stream_parser(is);
+    stream_parser.set_byte_range(web_data.size() / 2, web_data.size());
+    std::vector<std::string> second_half;
+    summarize(stream_parser, second_half);
+    REQUIRE(not second_half.empty());
+    REQUIRE(std::equal(
+        second_half.begin(), second_half.end(), web_expected.end() - second_half.size()));
+
+    auto path = std::filesystem::temp_directory_path() / "trecpp_test_range.trecweb";
+    {
+        std::ofstream file(path);
+        file << web_data;
+    }
+    for (bool direct : {false, true}) {
+        REQUIRE(split(
+                    [&] {
+                        return web::BasicTrecParser<FdSource>(FdSource(path.string(), direct));
+                    },
+                    web_data.size(),
+                    5000)
+                == web_expected);
+    }
+    std::filesystem::remove(path);
+
+    // Records are skipped and limited after the byte range is applied.
+    web::BasicTrecParser<ViewSource> parser(ViewSource{web_data}, 64);
+    REQUIRE(parser.skip(10) == 10);
+    parser.set_record_limit(5);
+    std::vector<std::string> limited;
+    summarize(parser, limited);
+    REQUIRE(limited
+            == std::vector<std::string>(web_expected.begin() + 10, web_expected.begin() + 15));
+    REQUIRE(parser.eof());
+    RecordBatch batch;
+    REQUIRE(parser.read_batch(batch, 10) == 0);
+    REQUIRE(batch.errors().empty());
+    parser.set_record_limit(1000);
+    REQUIRE(parser.skip(1000) == 285);
+
+    text::BasicTrecParser<text::DefaultContentTags, ViewSource> text_parser(ViewSource{text_data});
+    REQUIRE(text_parser.skip(299) == 299);
+    auto record = std::get<Record>(text_parser.read_record());
+    REQUIRE(record.trecid() == "FT299");
+    REQUIRE(text_parser.eof());
+}
+
 TEST_CASE("Match result", "[unit]")
 {
     Result result(Record("01", "URL", "CONTENT"));